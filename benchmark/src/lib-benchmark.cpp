@@ -35,15 +35,6 @@ using namespace lbcrypto;
  * Context setup utility methods
  */
 
-uint GetPSMDepth(uint p) {
-    uint depth = 0;
-    for(uint mask=1;mask<=p; mask <<= 1){
-      depth++;
-      if((mask&p)>0) depth++;
-    }
-    return depth-1;
-}
-
 CryptoContextSFDK<DCRTPoly> GenerateBFVrnsSFDKContext(uint32_t _depth = 1) {
 
 // Set the main parameters
@@ -82,14 +73,29 @@ CryptoContextSFDK<DCRTPoly> GenerateBFVrnsSFDKContext(uint32_t _depth = 1) {
 void BFVrnsSFDK_KeyGen(benchmark::State &state) {
   CryptoContextSFDK<DCRTPoly> cryptoContext = GenerateBFVrnsSFDKContext();
 
+  // Number of threads of the key generation, 0 for the current setting
+  const int threads = OpenFHEParallelControls.GetNumThreads();
+  if (state.range(0) > 0) {
+    OpenFHEParallelControls.SetNumThreads(state.range(0));
+  }
+
   KeyPairSFDK<DCRTPoly> keyPair;
 
   while (state.KeepRunning()) {
     keyPair = cryptoContext->KeyGenSFDK();
   }
+
+  OpenFHEParallelControls.SetNumThreads(threads);
 }
 
-BENCHMARK(BFVrnsSFDK_KeyGen)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BFVrnsSFDK_KeyGen)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime()
+    ->ArgName("threads")
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(0);
 
 void BFVrnsSFDK_MultKeyGen(benchmark::State &state) {
   CryptoContextSFDK<DCRTPoly> cc = GenerateBFVrnsSFDKContext();
@@ -315,7 +321,7 @@ void BFVrnsSFDK_sfdkDecrypt(benchmark::State &state) {
 BENCHMARK(BFVrnsSFDK_sfdkDecrypt)->Unit(benchmark::kMicrosecond);
 
 void BFVrnsSFDK_psm(benchmark::State &state) {
-  CryptoContextSFDK<DCRTPoly> cryptoContext = GenerateBFVrnsSFDKContext(16);
+  CryptoContextSFDK<DCRTPoly> cryptoContext = GenerateBFVrnsSFDKContext(SFDKBFVRNS::GetPSMDepth(65537));
   KeyPairSFDK<DCRTPoly> keyPair = cryptoContext->KeyGenSFDK();
   
   cryptoContext->EvalMultKeyGen(keyPair.secretKey);
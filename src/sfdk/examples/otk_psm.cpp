@@ -12,21 +12,10 @@
 using namespace lbcrypto;
 
 
-uint GetPSMDepth(uint p) {
-    uint depth = 0;
-    for(uint mask=1;mask<=p; mask <<= 1){
-      depth++;
-      if((mask&p)>0) depth++;
-    }
-    return depth-2;
-  }
-
-
-
 CryptoContextSFDK<DCRTPoly> GenerateBFVrnsSFDKContext() {
   // Set the main parameters
   uint32_t plaintextModulus = 65537;
-  uint32_t depth = GetPSMDepth(plaintextModulus);
+  uint32_t depth = SFDKBFVRNS::GetPSMDepth(plaintextModulus);
   std::cout << "  Depth: " << depth << std::endl;
 
   CCParams<CryptoContextBFVRNSSFDK> parameters;
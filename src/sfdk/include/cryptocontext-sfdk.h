@@ -14,9 +14,19 @@
 #include "key/keypair-sfdk.h"
 #include "key/cipherkey-sfdk.h"
 #include "cryptocontext-fwd-sfdk.h"
+#include "plaintextcache-sfdk.h"
 #include "scheme/bfvrns-sfdk/bfvrns-scheme-sfdk.h"
 #include "scheme/bfvrns-sfdk/gen-cryptocontext-bfvrns-sfdk.h"
 
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
 
 namespace lbcrypto {
 
@@ -25,8 +35,7 @@ namespace lbcrypto {
  * 
  */
 template <typename Element>
-class CryptoContextImplSFDK : public CryptoContextImpl<Element>, std::enable_shared_from_this<CryptoContextImplSFDK<Element>> {
-//class CryptoContextImplSFDK : public CryptoContextImpl<Element> {
+class CryptoContextImplSFDK : public CryptoContextImpl<Element>, public std::enable_shared_from_this<CryptoContextImplSFDK<Element>> {
     using IntType  = typename Element::Integer;
     using ParmType = typename Element::Params;
 
@@ -37,6 +46,9 @@ class CryptoContextImplSFDK : public CryptoContextImpl<Element>, std::enable_sha
 
     public:
 
+    // Used by cereal when a key or a ciphertext is deserialized
+    CryptoContextImplSFDK() : CryptoContextImpl<Element>() {}
+
     CryptoContextImplSFDK(CryptoParametersBase<Element>* params, SchemeBFVRNSSFDK* scheme,
                       SCHEME schemeId) : CryptoContextImpl<Element>(params,scheme,schemeId) {}
 
@@ -60,6 +72,20 @@ class CryptoContextImplSFDK : public CryptoContextImpl<Element>, std::enable_sha
         OPENFHE_THROW("Cannot find context for the given pointer to CryptoContextImpl");
     }
 
+    /**
+   * Gets the shared pointer owning this context in constant time. Contexts
+   * created by the factory are owned by a shared pointer; only a context
+   * living outside of one falls back to the registry lookup.
+   *
+   * @return the context.
+   */
+    const CryptoContextSFDK<Element> GetSFDKContext() const {
+        auto self = this->weak_from_this().lock();
+        if (self)
+            return std::const_pointer_cast<CryptoContextImplSFDK<Element>>(self);
+        return GetContextForPointer(this);
+    }
+
     void Enable(usint featureMask) {
         this->scheme->Enable(featureMask);
         if (featureMask & SFDK ) {
@@ -75,7 +101,7 @@ class CryptoContextImplSFDK : public CryptoContextImpl<Element>, std::enable_sha
    * @return function ran correctly.
    */
     KeyPairSFDK<Element> KeyGenSFDK() const {
-        return GetSFDKScheme()->KeyGen(GetContextForPointer(this), false);
+        return GetSFDKScheme()->KeyGen(GetSFDKContext(), false);
     }
 
     /**
@@ -86,7 +112,7 @@ class CryptoContextImplSFDK : public CryptoContextImpl<Element>, std::enable_sha
    * @return function ran correctly.
    */
     KeyPairSFDK<Element>  SparseKeyGenSFDK() const {
-        return GetSFDKScheme()->KeyGenInternal(GetContextForPointer(this), true);
+        return GetSFDKScheme()->KeyGen(GetSFDKContext(), true);
     }
 
     /**
@@ -101,6 +127,50 @@ class CryptoContextImplSFDK : public CryptoContextImpl<Element>, std::enable_sha
         return GetSFDKScheme()->GenDecKeyFor(cipherText, keyGen, publicKey);
     }
 
+    /**
+   * Function to generate decryption keys for many ciphertexts at once
+   *
+   * @param &cipherTexts ciphertexts to generate the decryption keys for.
+   * @param &keyGen key generator used to generate the decryption keys.
+   * @param &publicKey public key of the ciphertexts.
+   * @return one decryption key per ciphertext, in the same order.
+   */
+    std::vector<KeyCipher<Element>> GenDecKeysFor(std::vector<Ciphertext<Element>> &cipherTexts, KeyCipherGenKey<Element> keyGen, PublicKeySFDK<Element> publicKey) const {
+        return GetSFDKScheme()->GenDecKeysFor(cipherTexts, keyGen, publicKey);
+    }
+
+    /**
+   * Function to start precomputing trapdoor perturbations in background threads.
+   * Subsequent GenDecKeyFor calls with the same key generator only run the
+   * online sampling while the pool has perturbations available.
+   *
+   * @param &keyGen key generator used to generate the decryption keys.
+   * @param capacity number of perturbations kept ready.
+   * @param numThreads number of background threads filling the pool.
+   */
+    void StartPerturbationPool(KeyCipherGenKey<Element> keyGen, size_t capacity, usint numThreads = 1) const {
+        GetSFDKScheme()->StartPerturbationPool(keyGen, capacity, numThreads);
+    }
+
+    /**
+   * Function to stop the background threads filling the perturbation pool
+   *
+   * @param &keyGen key generator holding the pool.
+   */
+    void StopPerturbationPool(KeyCipherGenKey<Element> keyGen) const {
+        GetSFDKScheme()->StopPerturbationPool(keyGen);
+    }
+
+    /**
+   * Function to restart the random stream of a seeded context from its seed.
+   * GenCryptoContext returns the existing context for the same parameters,
+   * whose stream has moved on, so regenerating fixed keys in the same
+   * process needs this call first.
+   */
+    void ResetPRNGStream() const {
+        GetSFDKScheme()->ResetPRNGStream();
+    }
+
     /**
    * Method for encrypting plaintext using LBC
    *
@@ -131,6 +201,37 @@ class CryptoContextImplSFDK : public CryptoContextImpl<Element>, std::enable_sha
         return Encrypt(plaintext, publicKey);
     }
 
+    /**
+   * Method for encrypting many plaintexts under the same public key
+   *
+   * @param &plaintexts plaintexts to be encrypted.
+   * @param publicKey public key used for encryption.
+   * @return one ciphertext per plaintext, in the same order.
+   */
+    std::vector<Ciphertext<Element>> EncryptBatch(const std::vector<Plaintext>& plaintexts, const PublicKeySFDK<Element> publicKey) const {
+        std::vector<Element> elements;
+        elements.reserve(plaintexts.size());
+        for (const auto& plaintext : plaintexts) {
+            if (!plaintext)
+                OPENFHE_THROW("Input plaintext is nullptr");
+            elements.push_back(plaintext->GetElement<Element>());
+        }
+
+        std::vector<Ciphertext<Element>> ciphertexts = GetSFDKScheme()->EncryptBatch(std::move(elements), publicKey);
+
+        for (size_t i = 0; i < ciphertexts.size(); i++) {
+            const Plaintext& plaintext = plaintexts[i];
+            ciphertexts[i]->SetEncodingType(plaintext->GetEncodingType());
+            ciphertexts[i]->SetScalingFactor(plaintext->GetScalingFactor());
+            ciphertexts[i]->SetScalingFactorInt(plaintext->GetScalingFactorInt());
+            ciphertexts[i]->SetNoiseScaleDeg(plaintext->GetNoiseScaleDeg());
+            ciphertexts[i]->SetLevel(plaintext->GetLevel());
+            ciphertexts[i]->SetSlots(plaintext->GetSlots());
+        }
+
+        return ciphertexts;
+    }
+
     /**
    * Method for decrypting plaintext using LBC
    *
@@ -145,6 +246,18 @@ class CryptoContextImplSFDK : public CryptoContextImpl<Element>, std::enable_sha
         return GetSFDKScheme()->Decrypt(ciphertext, decKey, publicKey, plaintext);
     }
 
+    /**
+   * Creates a reusable decryption context for a public key. The returned
+   * object caches the key dependent setup of DecryptSFDK and can be shared
+   * by concurrent decryptions.
+   *
+   * @param publicKey public key used for decryption.
+   * @return the decryption context.
+   */
+    std::shared_ptr<SFDKDecryptor> MakeDecryptor(const PublicKeySFDK<Element> publicKey) const {
+        return GetSFDKScheme()->MakeDecryptor(publicKey);
+    }
+
 /**
  * @brief Method for testing if a ciphertext is a member of a set
  * 
@@ -158,6 +271,66 @@ Ciphertext<Element> PrivateSetMembership(Ciphertext<Element> &ciphertext, std::v
     return GetSFDKScheme()->PrivateSetMembership(ciphertext, testset, const_cast<CryptoContextImplSFDK<DCRTPoly>*>(this));
  }
    
+/**
+ * @brief Method for testing if a ciphertext is a member of a set, when the
+ * client encrypted the element in every slot (e.g. MakePackedPlaintext of a
+ * vector filled with the element). No rotations are needed to replicate it.
+ * 
+ * @param ciphertext with the element to be tested in every slot
+ * @param testset the set to be tested against, at most half the ring dimension
+ * @return Ciphertext<Element> 
+ */
+Ciphertext<Element> PrivateSetMembershipReplicated(Ciphertext<Element> &ciphertext, std::vector<int64_t> &testset) const {
+    return GetSFDKScheme()->PrivateSetMembershipReplicated(ciphertext, testset, const_cast<CryptoContextImplSFDK<DCRTPoly>*>(this));
+ }
+
+/**
+ * @brief Packs queries for PrivateSetMembershipPacked, query i at the start
+ * of block i
+ * 
+ * @param queries the elements to be tested, at most ring dimension / blockWidth
+ * @param blockWidth the width of the slot blocks
+ * @return Plaintext 
+ */
+Plaintext MakePackedQueries(const std::vector<int64_t> &queries, uint blockWidth) const {
+    if (queries.empty())
+        OPENFHE_THROW("No queries to pack");
+    if (blockWidth == 0 || queries.size() * blockWidth > this->GetRingDimension())
+        OPENFHE_THROW("Too many queries for the block width");
+    std::vector<int64_t> slots((queries.size() - 1) * blockWidth + 1, 0);
+    for (size_t i = 0; i < queries.size(); i++)
+        slots[i * blockWidth] = queries[i];
+    return this->MakePackedPlaintext(slots);
+ }
+
+/**
+ * @brief Method for testing many queries against the same set with one
+ * ciphertext. Answer i (0 if member, 1 otherwise) is in slot i*blockWidth.
+ * 
+ * @param ciphertext with the queries packed by MakePackedQueries
+ * @param testset the set to be tested against, at most blockWidth elements
+ * @param blockWidth power of two dividing half the ring dimension
+ * @return Ciphertext<Element> 
+ */
+Ciphertext<Element> PrivateSetMembershipPacked(Ciphertext<Element> &ciphertext, std::vector<int64_t> &testset, uint blockWidth) const {
+    return GetSFDKScheme()->PrivateSetMembershipPacked(ciphertext, testset, blockWidth, const_cast<CryptoContextImplSFDK<DCRTPoly>*>(this));
+ }
+
+/**
+ * @brief Method for counting how many queries are in a set. The queries are
+ * packed by MakePackedQueries, in the first half of the slots, and the count
+ * is returned in slot 0 instead of one bit per query.
+ * 
+ * @param ciphertext with the queries packed by MakePackedQueries
+ * @param testset the set to be tested against, at most blockWidth elements
+ * @param blockWidth power of two dividing half the ring dimension
+ * @param queries the number of queries packed, at most n/2/blockWidth
+ * @return Ciphertext<Element> 
+ */
+Ciphertext<Element> PrivateSetIntersectionCardinality(Ciphertext<Element> &ciphertext, std::vector<int64_t> &testset, uint blockWidth, uint queries) const {
+    return GetSFDKScheme()->PrivateSetIntersectionCardinality(ciphertext, testset, blockWidth, queries, const_cast<CryptoContextImplSFDK<DCRTPoly>*>(this));
+ }
+
 /**
  * @brief Method for testing if a ciphertext between two integers
  * 
@@ -172,6 +345,104 @@ Ciphertext<Element> PrivateSetMembership(Ciphertext<Element> &ciphertext, std::v
     return GetSFDKScheme()->PrivateSetMembership(ciphertext, start, size, const_cast<CryptoContextImplSFDK<DCRTPoly>*>(this));
  }
 
+/**
+ * @brief Encodes the base-adic digits of a range query, least significant
+ * digit in slot 0
+ * 
+ * @param value the element to be tested
+ * @param base the digit base
+ * @param digits the number of digits, base^digits must exceed value
+ * @return Plaintext 
+ */
+Plaintext MakeDigitQuery(uint64_t value, uint base, uint digits) const {
+    if (base < 2 || digits == 0)
+        OPENFHE_THROW("Invalid digit base or number of digits");
+    std::vector<int64_t> slots(digits, 0);
+    for (uint j = 0; j < digits; j++, value /= base)
+        slots[j] = int64_t(value % base);
+    if (value != 0)
+        OPENFHE_THROW("Value does not fit in the digits");
+    return this->MakePackedPlaintext(slots);
+ }
+
+/**
+ * @brief Method for testing if a query is between two integers with a cost
+ * polylogarithmic in the size of the interval
+ * 
+ * @param ciphertext with the digits of the query made by MakeDigitQuery
+ * @param start the lower bound of the interval
+ * @param size the size of the interval
+ * @param base the digit base of the query
+ * @param digits the number of digits of the query
+ * @return Ciphertext<Element> 0 in slot 0 if in the interval, 1 otherwise
+ */
+Ciphertext<Element> PrivateRangeMembership(Ciphertext<Element> &ciphertext, uint64_t start, uint64_t size, uint base, uint digits) const {
+    return GetSFDKScheme()->PrivateRangeMembership(ciphertext, start, size, base, digits, const_cast<CryptoContextImplSFDK<DCRTPoly>*>(this));
+ }
+
+/**
+ * @brief Method to generate the rotation keys of PrivateRangeMembership
+ * 
+ * @param secretKey 
+ * @param base the digit base of the queries
+ * @param digits the number of digits of the queries
+ */
+void PrepareRangeMembership(PrivateKey<Element> secretKey, uint base, uint digits)  {
+    return GetSFDKScheme()->PrepareRangeMembership(secretKey, base, digits, this);
+ }
+
+/**
+ * @brief Merges membership results into one ciphertext, the answer of
+ * results[i] in slot i. One GenDecKeyFor then opens all the answers.
+ * 
+ * @param results ciphertexts with their answer in slot 0, at most half the
+ * ring dimension of them
+ * @param mask true to clear the other slots of the results first, at the
+ * cost of one level. Needed for the results of PrivateSetMembershipPacked,
+ * which hold an answer at every block start
+ * @return Ciphertext<Element> 
+ */
+Ciphertext<Element> AggregateResults(const std::vector<Ciphertext<Element>> &results, bool mask = false) const {
+    return GetSFDKScheme()->AggregateResults(results, mask, const_cast<CryptoContextImplSFDK<DCRTPoly>*>(this));
+ }
+
+/**
+ * @brief Method to generate the rotation keys of AggregateResults
+ * 
+ * @param secretKey 
+ * @param count the number of results merged
+ */
+void PrepareAggregation(PrivateKey<Element> secretKey, uint count)  {
+    return GetSFDKScheme()->PrepareAggregation(secretKey, count, this);
+ }
+
+/**
+ * @brief Switches a result down to its first towers, so its one-time key is
+ * sampled and applied over those towers only. Use the keys of
+ * GenReducedKeys with the compacted result.
+ * 
+ * @param ciphertext the result to compact
+ * @param towers number of towers kept
+ * @return Ciphertext<Element> 
+ */
+Ciphertext<Element> CompactResult(ConstCiphertext<Element> ciphertext, uint towers = 2) const {
+    return GetSFDKScheme()->CompactResult(ciphertext, towers, const_cast<CryptoContextImplSFDK<DCRTPoly>*>(this));
+ }
+
+/**
+ * @brief Derives the public key and trapdoor of the first towers, for the
+ * one-time keys of results compacted by CompactResult. They can be derived
+ * once and reused for every compacted result.
+ * 
+ * @param publicKey full public key
+ * @param keyGen key generator holding the full trapdoor
+ * @param towers number of towers kept
+ * @return the reduced public key and key generator
+ */
+std::pair<PublicKeySFDK<Element>, KeyCipherGenKey<Element>> GenReducedKeys(PublicKeySFDK<Element> publicKey, KeyCipherGenKey<Element> keyGen, uint towers = 2) const {
+    return GetSFDKScheme()->GenReducedKeys(publicKey, keyGen, towers);
+ }
+
 /**
  * @brief Method to set the parameters for a Private Membership Test
  * 
@@ -184,6 +455,99 @@ void PreparePSM(PrivateKey<Element> secretKey, uint maxsize)  {
     return GetSFDKScheme()->PreparePSM(secretKey, maxsize, this);
  }
 
+/**
+ * @brief Generates the rotation keys a membership test is missing when it
+ * first needs them, instead of all the keys PreparePSM would make up front
+ * 
+ * A new key is inserted in the automorphism key map of OpenFHE, which
+ * rotations read without any lock, so a test that is missing keys throws if
+ * it runs inside a parallel region. Contexts queried from several threads
+ * call PreparePSM instead.
+ * 
+ * @param secretKey the key the rotation keys are generated for
+ */
+void EnableLazyRotationKeys(PrivateKey<Element> secretKey) {
+    std::lock_guard<std::mutex> lock(m_rotationKeyMutex);
+    m_lazyRotationKey = secretKey;
+}
+
+void DisableLazyRotationKeys() {
+    std::lock_guard<std::mutex> lock(m_rotationKeyMutex);
+    m_lazyRotationKey = nullptr;
+}
+
+/**
+ * @brief Generates the keys of the rotation indices that have none yet, if
+ * lazy rotation keys are enabled. Does nothing otherwise. The keys are
+ * generated aside and inserted at once, before the caller rotates.
+ * 
+ * @param indices rotation indices about to be used
+ */
+void EnsureRotationKeys(const std::vector<int32_t> &indices) {
+    std::lock_guard<std::mutex> lock(m_rotationKeyMutex);
+    if (!m_lazyRotationKey)
+        return;
+    const auto &allKeys = CryptoContextImpl<Element>::GetAllEvalAutomorphismKeys();
+    auto keys = allKeys.find(m_lazyRotationKey->GetKeyTag());
+    const usint m = this->GetCyclotomicOrder();
+    std::vector<int32_t> missing;
+    for (int32_t index : indices) {
+        if (keys == allKeys.end() || keys->second->count(FindAutomorphismIndex2n(index, m)) == 0)
+            missing.push_back(index);
+    }
+    if (missing.empty())
+        return;
+#ifdef _OPENMP
+    if (omp_in_parallel())
+        OPENFHE_THROW(config_error, "Lazy rotation keys cannot be generated inside a parallel region, call PreparePSM");
+#endif
+    auto newKeys = this->GetScheme()->EvalAtIndexKeyGen(nullptr, m_lazyRotationKey, missing);
+    CryptoContextImpl<Element>::InsertEvalAutomorphismKey(newKeys, m_lazyRotationKey->GetKeyTag());
+}
+
+/**
+ * @brief Reports the memory of every rotation key of a secret key
+ * 
+ * @param keyTag the tag of the secret key
+ * @return std::map<usint, size_t> bytes of the key of every automorphism index
+ */
+std::map<usint, size_t> GetRotationKeyMemory(const std::string &keyTag) const {
+    std::map<usint, size_t> memory;
+    const auto &allKeys = CryptoContextImpl<Element>::GetAllEvalAutomorphismKeys();
+    auto keys = allKeys.find(keyTag);
+    if (keys == allKeys.end())
+        return memory;
+    for (const auto &key : *keys->second) {
+        size_t bytes = 0;
+        for (const auto *polys : {&key.second->GetAVector(), &key.second->GetBVector()}) {
+            for (const auto &poly : *polys)
+                bytes += poly.GetNumOfElements() * poly.GetRingDimension() * sizeof(NativeInteger);
+        }
+        memory[key.first] = bytes;
+    }
+    return memory;
+}
+
+/**
+ * @brief Gets the cache of the plaintexts encoded by the membership tests:
+ * test sets, interval chunks and masks. Its hit and miss counters tell how
+ * often a test reused them.
+ * 
+ * @return std::shared_ptr<PlaintextCache> 
+ */
+std::shared_ptr<PlaintextCache> GetPlaintextCache() const {
+    return m_plaintextCache;
+}
+
+/**
+ * @brief Sets the memory limit of the plaintext cache, 0 disables it
+ * 
+ * @param maxBytes memory limit of the encoded plaintexts
+ */
+void SetPlaintextCacheLimit(size_t maxBytes) {
+    m_plaintextCache->SetMaxBytes(maxBytes);
+}
+
  /**
   * @brief Get the Zero Sponge Encryption object
   * 
@@ -225,6 +589,10 @@ Element GetDecryptionError(const PrivateKey<Element> privateKey, Ciphertext<Elem
     return GetSFDKScheme()->GetDecryptionError(privateKey, ciphertext, plaintext);
 }
 
+private:
+    std::shared_ptr<PlaintextCache> m_plaintextCache = std::make_shared<PlaintextCache>();
+    PrivateKey<Element> m_lazyRotationKey = nullptr;
+    std::mutex m_rotationKeyMutex;
 };
 
 }  // namespace lbcrypto
@@ -9,6 +9,7 @@
 
 #include "pke/cryptocontextfactory.h"
 #include "cryptocontext-fwd-sfdk.h"
+#include "scheme/bfvrns-sfdk/bfvrns-cryptoparameters-sfdk.h"
 
 
 namespace lbcrypto {
@@ -40,7 +41,20 @@ template <typename Element>
 inline CryptoContext<Element> CryptoContextFactorySFDK<Element>::GetContext(
     std::shared_ptr<CryptoParametersBase<Element>> params,
     std::shared_ptr<SchemeBase<Element>> scheme, SCHEME schemeId) {
-    CryptoContext<Element> cc = CryptoContextFactory<Element>::FindContext(params, scheme);
+    // The PRNG seed is not part of the parameter comparison, as it is never
+    // serialized, but contexts of different seeds must not be shared
+    auto seedOf = [](const std::shared_ptr<CryptoParametersBase<Element>>& p) -> uint64_t {
+        auto sfdkParams = std::dynamic_pointer_cast<CryptoParametersBFVRNSSFDK>(p);
+        return sfdkParams == nullptr ? 0 : sfdkParams->GetPRNGSeed();
+    };
+    CryptoContext<Element> cc = nullptr;
+    for (const auto& ctx : CryptoContextFactory<Element>::GetAllContexts()) {
+        if (*ctx->GetScheme() == *scheme && *ctx->GetCryptoParameters() == *params &&
+            seedOf(ctx->GetCryptoParameters()) == seedOf(params)) {
+            cc = ctx;
+            break;
+        }
+    }
     // if the context is not found we should create one
     if (nullptr == cc) {
         auto mscheme = std::static_pointer_cast<SchemeBFVRNSSFDK>(scheme);
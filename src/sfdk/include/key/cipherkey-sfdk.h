@@ -14,6 +14,10 @@
 #include "pke/cryptoobject.h"
 #include "publickey-sfdk.h"
 #include "cipherkey-fwd-sfdk.h"
+#include "utils_sfdk.h"
+
+#include <string>
+#include <vector>
 
 /**
  * @namespace lbcrypto
@@ -31,9 +35,63 @@ class KeyCipherImpl : public CryptoObject<Element> {
     explicit KeyCipherImpl(std::shared_ptr<Matrix<Element>> key, PublicKeySFDK<Element> publicKey) : 
       CryptoObject<Element>(publicKey->GetCryptoContext(), publicKey->GetKeyTag()), m_key(key) {
       }
+    KeyCipherImpl(CryptoContext<Element> cc = 0, const std::string &id = "")
+      : CryptoObject<Element>(cc, id) {}
+
   std::shared_ptr<Matrix<Element>> getPrivateElement() {
     return m_key;
   }
+
+    /**
+     * The key is stored with the small coefficients of every entry packed as
+     * signed varints, instead of full width residues in every tower. Keys of
+     * GenReducedKeys keep their number of towers.
+     */
+    template <class Archive>
+    void save(Archive &ar, std::uint32_t const version) const {
+        if (m_key == nullptr) {
+            OPENFHE_THROW(serialize_error, "The key has no decryption element to serialize");
+        }
+        ar(::cereal::base_class<CryptoObject<Element>>(this));
+        const Matrix<Element> &zHat = *m_key;
+        uint32_t rows = zHat.GetRows() * zHat.GetCols();
+        uint32_t towers = zHat(0, 0).GetNumOfElements();
+        ar(::cereal::make_nvp("r", rows));
+        ar(::cereal::make_nvp("t", towers));
+        ar(::cereal::make_nvp("z", SdfkUtils::packSmall(zHat)));
+    }
+
+    template <class Archive>
+    void load(Archive &ar, std::uint32_t const version) {
+        if (version > SerializedVersion()) {
+            OPENFHE_THROW(deserialize_error,
+                     "serialized object version " + std::to_string(version) +
+                         " is from a later version of the library");
+        }
+        ar(::cereal::base_class<CryptoObject<Element>>(this));
+        uint32_t rows = 0;
+        uint32_t towers = 0;
+        std::vector<uint8_t> packed;
+        ar(::cereal::make_nvp("r", rows));
+        ar(::cereal::make_nvp("t", towers));
+        ar(::cereal::make_nvp("z", packed));
+
+        auto params = this->GetCryptoContext()->GetElementParams();
+        const uint32_t total = params->GetParams().size();
+        if (towers == 0 || towers > total) {
+            OPENFHE_THROW(deserialize_error, "Serialized key does not match the towers of the context");
+        }
+        if (towers < total) {
+            Element reduced(params, Format::EVALUATION, true);
+            reduced.DropLastElements(total - towers);
+            params = reduced.GetParams();
+        }
+        m_key = std::make_shared<Matrix<Element>>(SdfkUtils::unpackSmall(packed, rows, params));
+    }
+
+    std::string SerializedObjectName() const { return "KeyCipher"; }
+    static uint32_t SerializedVersion() { return 1; }
+
   protected:
     std::shared_ptr<Matrix<Element>> m_key;
 };
@@ -12,7 +12,13 @@
 #define LBCRYPTO_CRYPTO_KEY_CIPHERKEYGEN_SFDK_H
 
 #include "cipherkeygen-fwd-sfdk.h"
+#include "perturbationpool-sfdk.h"
 #include "lattice/trapdoor.h"
+#include "cereal/types/complex.hpp"
+
+#include <complex>
+#include <string>
+#include <vector>
 
 /**
  * @namespace lbcrypto
@@ -37,11 +43,15 @@ class KeyCipherGenKeyImpl : public Key<Element> {
     KeyCipherGenKeyImpl(const KeyCipherGenKeyImpl<Element> &rhs)
       : Key<Element>(rhs.GetCryptoContext(), rhs.GetKeyTag()) {
       this->m_key = rhs.m_key;
+      this->m_pool = rhs.m_pool;
+      this->m_factors = rhs.m_factors;
     }
 
     KeyCipherGenKeyImpl(KeyCipherGenKeyImpl<Element> &&rhs)
       : Key<Element>(rhs.GetCryptoContext(), rhs.GetKeyTag()) {
         this->m_key = std::move(rhs.m_key);
+        this->m_pool = std::move(rhs.m_pool);
+        this->m_factors = std::move(rhs.m_factors);
     }
 
     operator bool() const { return static_cast<bool>(this->context); }
@@ -49,12 +59,16 @@ class KeyCipherGenKeyImpl : public Key<Element> {
     const KeyCipherGenKeyImpl<Element> &operator=(const KeyCipherGenKeyImpl<Element> &rhs) {
         CryptoObject<Element>::operator=(rhs);
         this->m_key = rhs.m_key;
+        this->m_pool = rhs.m_pool;
+        this->m_factors = rhs.m_factors;
         return *this;
     }
 
     const KeyCipherGenKeyImpl<Element> &operator=(KeyCipherGenKeyImpl<Element> &&rhs) {
         CryptoObject<Element>::operator=(rhs);
         this->m_key = std::move(rhs.m_key);
+        this->m_pool = std::move(rhs.m_pool);
+        this->m_factors = std::move(rhs.m_factors);
         return *this;
     }
 
@@ -62,6 +76,21 @@ class KeyCipherGenKeyImpl : public Key<Element> {
 
     void SetPrivateElement(const std::shared_ptr<RLWETrapdoorPair<Element>> x) { m_key = x; }
 
+    /**
+     * Gets the pool of precomputed perturbation vectors, nullptr if none was started
+     */
+    const std::shared_ptr<PerturbationPool<Element>> GetPerturbationPool() const { return m_pool; }
+
+    void SetPerturbationPool(const std::shared_ptr<PerturbationPool<Element>> pool) { m_pool = pool; }
+
+    /**
+     * Gets the covariance terms a, b and d of the perturbation sampling, in
+     * EVALUATION format, empty if they were not precomputed
+     */
+    const std::vector<Field2n> &GetPerturbationFactors() const { return m_factors; }
+
+    void SetPerturbationFactors(std::vector<Field2n> factors) { m_factors = std::move(factors); }
+
     bool operator==(const KeyCipherGenKeyImpl &other) const {
         return CryptoObject<Element>::operator==(other) && m_key == other.m_key;
     }
@@ -74,6 +103,8 @@ class KeyCipherGenKeyImpl : public Key<Element> {
     void save(Archive &ar, std::uint32_t const version) const {
         ar(::cereal::base_class<Key<Element>>(this));
         ar(::cereal::make_nvp("s", m_key));
+        std::vector<std::vector<std::complex<double>>> factors(m_factors.begin(), m_factors.end());
+        ar(::cereal::make_nvp("pf", factors));
     }
 
     template <class Archive>
@@ -85,14 +116,27 @@ class KeyCipherGenKeyImpl : public Key<Element> {
         }
         ar(::cereal::base_class<Key<Element>>(this));
         ar(::cereal::make_nvp("s", m_key));
+        // No class version is registered, so the factors cannot be gated on it
+        std::vector<std::vector<std::complex<double>>> factors;
+        ar(::cereal::make_nvp("pf", factors));
+        m_factors.clear();
+        for (auto &values : factors) {
+            Field2n factor(values.size(), Format::EVALUATION);
+            std::copy(values.begin(), values.end(), factor.begin());
+            m_factors.push_back(std::move(factor));
+        }
     }
 
     std::string SerializedObjectName() const { return "KeyCipherGenKey"; }
-    static uint32_t SerializedVersion() { return 1; }
+    static uint32_t SerializedVersion() { return 2; }
 
 
   protected:
     std::shared_ptr<RLWETrapdoorPair<Element>> m_key;
+    // Precomputed perturbations for the trapdoor, not serialized
+    std::shared_ptr<PerturbationPool<Element>> m_pool;
+    // Covariance terms of the perturbation, derived from the trapdoor once
+    std::vector<Field2n> m_factors;
 };
 
 }  // namespace lbcrypto
@@ -0,0 +1,172 @@
+//==================================================================================
+//
+// Author Carlos Ribeiro
+//
+//==================================================================================
+
+/*
+  Pool of precomputed trapdoor perturbation vectors
+ */
+
+#ifndef LBCRYPTO_CRYPTO_KEY_PERTURBATIONPOOL_SFDK_H
+#define LBCRYPTO_CRYPTO_KEY_PERTURBATIONPOOL_SFDK_H
+
+#include "math/matrix.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @namespace lbcrypto
+ * The namespace of lbcrypto
+ */
+namespace lbcrypto {
+
+/**
+ * @brief Thread-safe pool of perturbation vectors for the offline phase of
+ * GaussSamp.
+ *
+ * The perturbation does not depend on the syndrome being sampled, so it can be
+ * produced ahead of time by background workers. Consumers take one vector per
+ * one-time key and only run the online (G-lattice) phase.
+ * @tparam Element a ring element.
+ */
+template <class Element>
+class PerturbationPool {
+  public:
+    using Sampler = std::function<std::shared_ptr<Matrix<Element>>()>;
+
+    /**
+     * @param sampler function producing one perturbation vector
+     * @param capacity number of vectors kept ready in the pool
+     * @param numThreads number of background workers refilling the pool
+     */
+    PerturbationPool(Sampler sampler, size_t capacity, usint numThreads = 1)
+      : m_sampler(sampler), m_capacity(capacity), m_numThreads(numThreads == 0 ? 1 : numThreads) {}
+
+    PerturbationPool(const PerturbationPool<Element> &rhs) = delete;
+    PerturbationPool<Element> &operator=(const PerturbationPool<Element> &rhs) = delete;
+
+    ~PerturbationPool() { Stop(); }
+
+    /**
+     * Starts the background workers. Does nothing if they are already running.
+     */
+    void Start() {
+        std::lock_guard<std::mutex> workersLock(m_workersMutex);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_stop) return;
+        m_stop = false;
+        for (usint i = 0; i < m_numThreads; i++) {
+            m_workers.emplace_back(&PerturbationPool<Element>::Refill, this);
+        }
+    }
+
+    /**
+     * Stops the background workers. Vectors already in the pool are kept.
+     */
+    void Stop() {
+        // The workers are joined outside m_mutex, which they need to finish
+        std::lock_guard<std::mutex> workersLock(m_workersMutex);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_notFull.notify_all();
+        for (auto &worker : m_workers) {
+            if (worker.joinable()) worker.join();
+        }
+        m_workers.clear();
+    }
+
+    /**
+     * Fills the pool up to its capacity in the calling thread.
+     */
+    void Fill() {
+        for (;;) {
+            {
+                // The slot is reserved like the workers do, so the pool
+                // never goes over its capacity
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_pool.size() + m_pending >= m_capacity) return;
+                m_pending++;
+            }
+            std::shared_ptr<Matrix<Element>> perturbation = nullptr;
+            try {
+                perturbation = m_sampler();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_pending--;
+                throw;
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending--;
+            m_pool.push_back(std::move(perturbation));
+        }
+    }
+
+    /**
+     * Takes a precomputed perturbation vector out of the pool.
+     * @return the perturbation vector, or nullptr if the pool is empty
+     */
+    std::shared_ptr<Matrix<Element>> Take() {
+        std::shared_ptr<Matrix<Element>> perturbation = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_pool.empty()) return nullptr;
+            perturbation = std::move(m_pool.front());
+            m_pool.pop_front();
+        }
+        m_notFull.notify_one();
+        return perturbation;
+    }
+
+    size_t Size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pool.size();
+    }
+
+    size_t GetCapacity() const { return m_capacity; }
+
+  private:
+    void Refill() {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_notFull.wait(lock, [this] { return m_stop || m_pool.size() + m_pending < m_capacity; });
+                if (m_stop) return;
+                m_pending++;
+            }
+            std::shared_ptr<Matrix<Element>> perturbation = nullptr;
+            try {
+                perturbation = m_sampler();
+            } catch (...) {
+                // a failing sampler stops this worker; the online path falls back to GaussSamp
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending--;
+            if (perturbation == nullptr) return;
+            m_pool.push_back(std::move(perturbation));
+        }
+    }
+
+    Sampler m_sampler;
+    size_t m_capacity;
+    usint m_numThreads;
+    size_t m_pending = 0;
+    bool m_stop = true;
+    std::deque<std::shared_ptr<Matrix<Element>>> m_pool;
+    std::vector<std::thread> m_workers;
+    // Orders Start and Stop, which read and join the workers
+    std::mutex m_workersMutex;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notFull;
+};
+
+}  // namespace lbcrypto
+#endif  // LBCRYPTO_CRYPTO_KEY_PERTURBATIONPOOL_SFDK_H
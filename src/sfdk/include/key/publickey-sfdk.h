@@ -15,6 +15,9 @@
 #include "cryptocontext-sfdk.h"
 #include "pke/key/publickey.h"
 #include "lattice/trapdoor.h"
+#include "utils_sfdk.h"
+
+#include <array>
 
 /**
  * @namespace lbcrypto
@@ -37,7 +40,8 @@ public:
    *@param &rhs PublicKeyImpl to copy from
    */
     explicit PublicKeyImplSFDK(const PublicKeyImplSFDK<Element>& rhs)
-        : PublicKeyImpl<Element>(rhs.GetCryptoContext(), rhs.GetKeyTag()), m_xh(rhs.m_xh) {}
+        : PublicKeyImpl<Element>(rhs.GetCryptoContext(), rhs.GetKeyTag()), m_xh(rhs.m_xh),
+          m_seed(rhs.m_seed), m_seeded(rhs.m_seeded) {}
 
 
     /**
@@ -55,7 +59,7 @@ public:
    */
     explicit PublicKeyImplSFDK(PublicKeyImplSFDK<Element>&& rhs) noexcept
         : PublicKeyImpl<Element>(rhs.GetCryptoContext(), rhs.GetKeyTag()), 
-            m_xh(std::move(rhs.m_xh)) {}
+            m_xh(std::move(rhs.m_xh)), m_seed(rhs.m_seed), m_seeded(rhs.m_seeded) {}
 
     operator bool() const {
         return static_cast<bool>(this->context) && m_xh.size() != 0;
@@ -69,6 +73,8 @@ public:
     PublicKeyImplSFDK<Element>& operator=(const PublicKeyImplSFDK<Element>& rhs) {
         CryptoObject<Element>::operator=(rhs);
         this->m_xh = rhs.m_xh;
+        m_seed     = rhs.m_seed;
+        m_seeded   = rhs.m_seeded;
         return *this;
     }
 
@@ -80,6 +86,8 @@ public:
     PublicKeyImplSFDK<Element>& operator=(PublicKeyImplSFDK<Element>&& rhs) {
         CryptoObject<Element>::operator=(rhs);
         m_xh = std::move(rhs.m_xh);
+        m_seed   = rhs.m_seed;
+        m_seeded = rhs.m_seeded;
         return *this;
     }
 
@@ -93,8 +101,35 @@ public:
         return this->m_xh;
     }
 
+    /**
+   * Tells if the uniform column of the trapdoor matrix is expanded from a seed
+   * @return true if the key has a seed.
+   */
+    bool IsSeeded() const {
+        return m_seeded;
+    }
+
+    /**
+   * Gets the seed the uniform column of the trapdoor matrix is expanded from
+   * @return the 32-byte seed.
+   */
+    const std::array<uint32_t, 8>& GetSeed() const {
+        return m_seed;
+    }
+
     // @Set Properties
 
+    /**
+   * Sets the seed of the uniform column of the trapdoor matrix. Seeded keys
+   * are serialized without the first two columns of the matrix, which are
+   * rebuilt from the seed when the key is loaded.
+   * @param &seed the 32-byte seed.
+   */
+    void SetSeed(const std::array<uint32_t, 8>& seed) {
+        m_seed   = seed;
+        m_seeded = true;
+    }
+
     /**
    * Sets the public key vector of Element.
    * @param &element is the public key Element vector to be copied.
@@ -152,7 +187,22 @@ public:
     template <class Archive>
     void save(Archive& ar, std::uint32_t const version) const {
         ar(::cereal::base_class<Key<Element>>(this));
-        ar(::cereal::make_nvp("h", m_xh));
+        ar(::cereal::make_nvp("sd", m_seeded));
+        if (!m_seeded) {
+            ar(::cereal::make_nvp("h", m_xh));
+            return;
+        }
+        // Columns 0 and 1 of the trapdoor matrix (1 and the uniform a) are
+        // rebuilt from the seed, only b and the trapdoor columns are stored
+        const Matrix<Element>& A = m_xh[1];
+        std::vector<Element> td;
+        td.reserve(A.GetCols() - 2);
+        for (size_t i = 2; i < A.GetCols(); i++) {
+            td.push_back(A(0, i));
+        }
+        ar(::cereal::make_nvp("s", m_seed));
+        ar(::cereal::make_nvp("b", m_xh[0]));
+        ar(::cereal::make_nvp("t", td));
     }
 
     template <class Archive>
@@ -162,20 +212,44 @@ public:
                           " is from a later version of the library");
         }
         ar(::cereal::base_class<Key<Element>>(this));
-        ar(::cereal::make_nvp("h", m_xh));
+        // No class version is registered, so the flag cannot be gated on it
+        ar(::cereal::make_nvp("sd", m_seeded));
+        if (!m_seeded) {
+            ar(::cereal::make_nvp("h", m_xh));
+            return;
+        }
+
+        Matrix<Element> b([]() { return Element(); }, 0, 0);
+        std::vector<Element> td;
+        ar(::cereal::make_nvp("s", m_seed));
+        ar(::cereal::make_nvp("b", b));
+        ar(::cereal::make_nvp("t", td));
+
+        auto params = this->GetCryptoContext()->GetElementParams();
+        Matrix<Element> A(Element::Allocator(params, Format::EVALUATION), 1, td.size() + 2);
+        A(0, 0) = 1;
+        A(0, 1) = SdfkUtils::expandUniform(m_seed, params);
+        for (size_t i = 0; i < td.size(); i++) {
+            A(0, i + 2) = std::move(td[i]);
+        }
+        m_xh.clear();
+        m_xh.push_back(std::move(b));
+        m_xh.push_back(std::move(A));
     }
 
     std::string SerializedObjectName() const {
         return "PublicKeySFDK";
     }
     static uint32_t SerializedVersion() {
-        return 1;
+        return 2;
     }
 
     Matrix<Element> m_error;
     Element m_s;
 private:
     std::vector<Matrix<Element>> m_xh;
+    std::array<uint32_t, 8> m_seed{};
+    bool m_seeded = false;
 };
 
 }  // namespace lbcrypto
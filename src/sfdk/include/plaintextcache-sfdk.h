@@ -0,0 +1,171 @@
+//==================================================================================
+//
+// Author Carlos Ribeiro
+//
+//==================================================================================
+
+/*
+  Cache of encoded plaintexts reused by the membership tests
+ */
+
+#ifndef LBCRYPTO_CRYPTO_PLAINTEXTCACHE_SFDK_H
+#define LBCRYPTO_CRYPTO_PLAINTEXTCACHE_SFDK_H
+
+#include "encoding/plaintext.h"
+#include "lattice/lat-hal.h"
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @namespace lbcrypto
+ * The namespace of lbcrypto
+ */
+namespace lbcrypto {
+
+/**
+ * @brief Thread-safe LRU cache of encoded plaintexts.
+ *
+ * An entry is the list of plaintexts a membership test needs for one test set,
+ * interval or mask layout. Entries are evicted, least recently used first,
+ * when the memory of the encoded elements goes over the limit.
+ */
+class PlaintextCache {
+  public:
+    using Entry = std::vector<Plaintext>;
+    using Maker = std::function<Entry()>;
+
+    static constexpr size_t DEFAULT_MAX_BYTES = size_t(1) << 28;
+
+    /**
+     * @param maxBytes memory limit of the encoded plaintexts
+     */
+    explicit PlaintextCache(size_t maxBytes = DEFAULT_MAX_BYTES) : m_maxBytes(maxBytes) {}
+
+    PlaintextCache(const PlaintextCache &rhs) = delete;
+    PlaintextCache &operator=(const PlaintextCache &rhs) = delete;
+
+    /**
+     * Builds the key of an entry from a tag naming the layout and its values.
+     */
+    static std::string MakeKey(const std::string &tag, const std::vector<int64_t> &values) {
+        std::string key(tag);
+        key.push_back('\0');
+        key.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(int64_t));
+        return key;
+    }
+
+    /**
+     * Returns the entry of a key, making and inserting it on a miss. The entry
+     * is made outside of the lock, so concurrent misses may both make it.
+     * @param key key built by MakeKey
+     * @param make function encoding the plaintexts of the entry
+     * @return the plaintexts of the entry
+     */
+    Entry Get(const std::string &key, const Maker &make) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_index.find(key);
+            if (it != m_index.end()) {
+                m_hits++;
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                return it->second->plaintexts;
+            }
+            m_misses++;
+        }
+
+        Entry plaintexts = make();
+        size_t bytes = key.size();
+        for (const auto &plaintext : plaintexts) {
+            const DCRTPoly &element = plaintext->GetElement<DCRTPoly>();
+            bytes += element.GetNumOfElements() * element.GetRingDimension() * sizeof(NativeInteger);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (bytes > m_maxBytes || m_index.count(key) != 0) return plaintexts;
+        m_entries.push_front({key, plaintexts, bytes});
+        m_index[key] = m_entries.begin();
+        m_bytes += bytes;
+        Evict();
+        return plaintexts;
+    }
+
+    /**
+     * Sets the memory limit, evicting entries if it is now exceeded.
+     */
+    void SetMaxBytes(size_t maxBytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_maxBytes = maxBytes;
+        Evict();
+    }
+
+    size_t GetMaxBytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_maxBytes;
+    }
+
+    size_t GetBytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bytes;
+    }
+
+    size_t Size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+    uint64_t GetHits() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_hits;
+    }
+
+    uint64_t GetMisses() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_misses;
+    }
+
+    /**
+     * Drops every entry and resets the counters.
+     */
+    void Clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_index.clear();
+        m_bytes  = 0;
+        m_hits   = 0;
+        m_misses = 0;
+    }
+
+  private:
+    struct Node {
+        std::string key;
+        Entry plaintexts;
+        size_t bytes;
+    };
+
+    // called with the lock held
+    void Evict() {
+        while (m_bytes > m_maxBytes && !m_entries.empty()) {
+            m_bytes -= m_entries.back().bytes;
+            m_index.erase(m_entries.back().key);
+            m_entries.pop_back();
+        }
+    }
+
+    size_t m_maxBytes;
+    size_t m_bytes    = 0;
+    uint64_t m_hits   = 0;
+    uint64_t m_misses = 0;
+    std::list<Node> m_entries;
+    std::unordered_map<std::string, std::list<Node>::iterator> m_index;
+    mutable std::mutex m_mutex;
+};
+
+}  // namespace lbcrypto
+#endif  // LBCRYPTO_CRYPTO_PLAINTEXTCACHE_SFDK_H
@@ -49,7 +49,10 @@ class CryptoParametersBFVRNSSFDK : public CryptoParametersBFVRNS {
 public:
     CryptoParametersBFVRNSSFDK() : CryptoParametersBFVRNS() {}
 
-    CryptoParametersBFVRNSSFDK(const CryptoParametersBFVRNSSFDK& rhs) : CryptoParametersBFVRNS(rhs) {}
+    CryptoParametersBFVRNSSFDK(const CryptoParametersBFVRNSSFDK& rhs)
+        : CryptoParametersBFVRNS(rhs), m_base(rhs.m_base), m_k(rhs.m_k), VerifyNorm(rhs.VerifyNorm),
+          m_seededPublicKey(rhs.m_seededPublicKey), m_approxTrapdoorDigits(rhs.m_approxTrapdoorDigits),
+          m_prngSeed(rhs.m_prngSeed) {}
 
     CryptoParametersBFVRNSSFDK(std::shared_ptr<ParmType> params, const PlaintextModulus& plaintextModulus,
                            float distributionParameter, float assuranceMeasure, SecurityLevel securityLevel,
@@ -57,10 +60,12 @@ public:
                            KeySwitchTechnique ksTech = BV, ScalingTechnique scalTech = FIXEDMANUAL,
                            EncryptionTechnique encTech = STANDARD, MultiplicationTechnique multTech = HPS,
                            MultipartyMode multipartyMode = FIXED_NOISE_MULTIPARTY,
-                           usint base = 2, bool VerifyNormFlag = false)
+                           usint base = 2, bool VerifyNormFlag = false, bool seededPublicKey = false,
+                           usint approxTrapdoorDigits = 0, uint64_t prngSeed = 0)
         : CryptoParametersBFVRNS(params, plaintextModulus, distributionParameter, assuranceMeasure, securityLevel,
                               digitSize, secretKeyDist, maxRelinSkDeg, ksTech, scalTech, encTech, multTech,
-                              multipartyMode), m_base(base), VerifyNorm(VerifyNormFlag) {}
+                              multipartyMode), m_base(base), VerifyNorm(VerifyNormFlag), m_seededPublicKey(seededPublicKey),
+                              m_approxTrapdoorDigits(approxTrapdoorDigits), m_prngSeed(prngSeed) {}
 
     CryptoParametersBFVRNSSFDK(std::shared_ptr<ParmType> params, EncodingParams encodingParams, float distributionParameter,
                            float assuranceMeasure, SecurityLevel securityLevel, usint digitSize,
@@ -72,11 +77,14 @@ public:
                            DecryptionNoiseMode decryptionNoiseMode = FIXED_NOISE_DECRYPT,
                            PlaintextModulus noiseScale = 1, uint32_t statisticalSecurity = 30,
                            uint32_t numAdversarialQueries = 1, uint32_t thresholdNumOfParties = 1,
-                           usint base = 2, bool VerifyNormFlag = false)
+                           usint base = 2, bool VerifyNormFlag = false, bool seededPublicKey = false,
+                           usint approxTrapdoorDigits = 0, uint64_t prngSeed = 0)
         : CryptoParametersBFVRNS(params, encodingParams, distributionParameter, assuranceMeasure, securityLevel, digitSize,
                               secretKeyDist, maxRelinSkDeg, ksTech, scalTech, encTech, multTech, PREMode,
                               multipartyMode, executionMode, decryptionNoiseMode, noiseScale, statisticalSecurity,
-                              numAdversarialQueries, thresholdNumOfParties), m_base(base), VerifyNorm(VerifyNormFlag) {}
+                              numAdversarialQueries, thresholdNumOfParties), m_base(base), VerifyNorm(VerifyNormFlag),
+                              m_seededPublicKey(seededPublicKey), m_approxTrapdoorDigits(approxTrapdoorDigits),
+                              m_prngSeed(prngSeed) {}
 
     virtual ~CryptoParametersBFVRNSSFDK() {}
 
@@ -84,6 +92,12 @@ public:
     void SetK(usint k){m_k = k;}
     usint GetBase() const {return m_base;}
     void SetBase(usint base){m_base = base;}
+    bool GetSeededPublicKey() const {return m_seededPublicKey;}
+    void SetSeededPublicKey(bool seededPublicKey){m_seededPublicKey = seededPublicKey;}
+    usint GetApproxTrapdoorDigits() const {return m_approxTrapdoorDigits;}
+    void SetApproxTrapdoorDigits(usint approxTrapdoorDigits){m_approxTrapdoorDigits = approxTrapdoorDigits;}
+    uint64_t GetPRNGSeed() const {return m_prngSeed;}
+    void SetPRNGSeed(uint64_t prngSeed){m_prngSeed = prngSeed;}
     typename DCRTPoly::DggType &GetDiscreteGaussianGeneratorLargeSigma() {return m_dggLargeSigma;}
 
     bool operator==(const CryptoParametersBase<DCRTPoly>& rhs) const override {
@@ -92,7 +106,10 @@ public:
 
         if (el == nullptr) return false;
 
-        return el->GetK() == m_k && CryptoParametersBFVRNSSFDK::operator==(rhs);
+        // m_k is derived from the modulus at KeyGen and m_prngSeed is not
+        // serialized, so neither takes part in the comparison
+        return el->GetBase() == m_base && el->GetSeededPublicKey() == m_seededPublicKey &&
+               el->GetApproxTrapdoorDigits() == m_approxTrapdoorDigits && CryptoParametersBFVRNS::operator==(rhs);
     } 
     /////////////////////////////////////
     // SERIALIZATION
@@ -100,7 +117,11 @@ public:
 
     template <class Archive>
     void save(Archive& ar, std::uint32_t const version) const {
-        ar(cereal::base_class<CryptoParametersBFVRNSSFDK>(this));
+        ar(cereal::base_class<CryptoParametersBFVRNS>(this));
+        ar(cereal::make_nvp("tb", m_base));
+        ar(cereal::make_nvp("tk", m_k));
+        ar(cereal::make_nvp("spk", m_seededPublicKey));
+        ar(cereal::make_nvp("atd", m_approxTrapdoorDigits));
     }
 
     template <class Archive>
@@ -111,7 +132,11 @@ public:
             OPENFHE_THROW(errMsg);
         }
 
-        ar(cereal::base_class<CryptoParametersBFVRNSSFDK>(this));
+        ar(cereal::base_class<CryptoParametersBFVRNS>(this));
+        ar(cereal::make_nvp("tb", m_base));
+        ar(cereal::make_nvp("tk", m_k));
+        ar(cereal::make_nvp("spk", m_seededPublicKey));
+        ar(cereal::make_nvp("atd", m_approxTrapdoorDigits));
 
         if (PrecomputeCRTTablesAfterDeserializaton()) {
             PrecomputeCRTTables(m_ksTechnique, m_scalTechnique, m_encTechnique, m_multTechnique, m_numPartQ, m_auxBits,
@@ -129,9 +154,9 @@ public:
     protected:
 
     // Trapdoor base
-    usint m_base;
-    // Trapdoor length
-    usint m_k;
+    usint m_base = 2;
+    // Trapdoor length, set by KeyGen
+    usint m_k = 0;
 
     // Discrete Gaussian Generator for random number generation
     typename DCRTPoly::DggType m_dgg;
@@ -141,7 +166,18 @@ public:
     typename DCRTPoly::DggType m_dggLargeSigma;
 
     //flag for verifying norm of trapdoor
-    bool VerifyNorm;
+    bool VerifyNorm = false;
+
+    //flag for expanding the uniform part of the public key from a seed
+    bool m_seededPublicKey = false;
+
+    // Number of low gadget digits left out of the approximate trapdoor
+    usint m_approxTrapdoorDigits = 0;
+
+    // Seed of the random stream of the context, 0 for the global generator.
+    // It determines the secret keys, so it is never serialized. The factory
+    // keeps contexts of different seeds apart.
+    uint64_t m_prngSeed = 0;
 };
 
 }  // namespace lbcrypto
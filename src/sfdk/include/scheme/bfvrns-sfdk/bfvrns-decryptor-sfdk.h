@@ -0,0 +1,70 @@
+//==================================================================================
+// Author Carlos Ribeiro
+//
+//==================================================================================
+
+#ifndef LBCRYPTO_CRYPTO_BFVRNS_SFDK_DECRYPTOR_H
+#define LBCRYPTO_CRYPTO_BFVRNS_SFDK_DECRYPTOR_H
+
+#include "openfhe.h"
+#include "cryptocontext-sfdk.h"
+#include "scheme/bfvrns-sfdk/bfvrns-cryptoparameters-sfdk.h"
+
+#include <memory>
+
+/**
+ * @namespace lbcrypto
+ * The namespace of lbcrypto
+ */
+namespace lbcrypto {
+
+/**
+ * @brief Decryption context bound to one public key. Everything that does
+ * not depend on the ciphertext (the EVALUATION form of b, the plaintext ring
+ * parameters and the crypto parameters holding the ScaleAndRound tables) is
+ * prepared once in the constructor. The object is immutable afterwards, so a
+ * single instance can be shared by many threads.
+ */
+class SFDKDecryptor {
+public:
+    /**
+   * Builds the decryption context for a public key
+   *
+   * @param publicKey public key the ciphertexts were encrypted with.
+   */
+    explicit SFDKDecryptor(const PublicKeySFDK<DCRTPoly> publicKey);
+
+    /**
+   * Method for decrypting a ciphertext with its one-time key
+   *
+   * @param &ciphertext ciphertext to be decrypted.
+   * @param &decKey decryption key generated for the ciphertext.
+   * @param *plaintext the plaintext output.
+   * @return the decoding result.
+   */
+    DecryptResult Decrypt(const Ciphertext<DCRTPoly> &ciphertext, const KeyCipher<DCRTPoly> &decKey,
+                          Plaintext* plaintext) const ;
+
+    /**
+   * Scales the decrypted element by t/q and rounds it into the plaintext.
+   * Elements with fewer towers than the parameters, as compacted results,
+   * are scaled on their interpolated coefficients.
+   *
+   * @param &b the decrypted element, in any format.
+   * @param *plaintext the plaintext element output.
+   * @param cryptoParams parameters holding the scaling tables.
+   * @return the decoding result.
+   */
+    static DecryptResult ScaleAndRound(DCRTPoly &b, NativePoly *plaintext,
+                                       const std::shared_ptr<CryptoParametersBFVRNSSFDK> &cryptoParams);
+
+private:
+    std::shared_ptr<CryptoParametersBFVRNSSFDK> m_cryptoParams;
+    EncodingParams m_encodingParams;
+    std::shared_ptr<typename NativePoly::Params> m_plaintextParams;
+    Matrix<DCRTPoly> m_b;
+};
+
+}  // namespace lbcrypto
+
+#endif
@@ -38,6 +38,7 @@
 #include "scheme/bfvrns-sfdk/bfvrns-cryptoparameters-sfdk.h"
 #include "pke/scheme/bfvrns/bfvrns-parametergeneration.h"
 #include "scheme/bfvrns-sfdk/bfvrns-sfdk.h"
+#include "scheme/bfvrns-sfdk/bfvrns-decryptor-sfdk.h"
 
 #include <string>
 #include <memory>
@@ -156,6 +157,35 @@ class SchemeBFVRNSSFDK : public SchemeBFVRNS {
     return m_SFDKBase->GenDecKeyFor(cipherText, keyGen, publicKey);
   }
 
+  virtual std::vector<KeyCipher<DCRTPoly>> GenDecKeysFor(
+      std::vector<Ciphertext<DCRTPoly>> &cipherTexts,
+      KeyCipherGenKey<DCRTPoly> keyGen,
+      PublicKeySFDK<DCRTPoly> publicKey) const {
+    VerifySFDKEnabled(__func__);
+    if (!publicKey) OPENFHE_THROW("Input public key is nullptr");
+    if (!keyGen) OPENFHE_THROW("Input generation key is nullptr");
+    return m_SFDKBase->GenDecKeysFor(cipherTexts, keyGen, publicKey);
+  }
+
+  virtual void StartPerturbationPool(KeyCipherGenKey<DCRTPoly> keyGen,
+                                     size_t capacity, usint numThreads) const {
+    VerifySFDKEnabled(__func__);
+    if (!keyGen) OPENFHE_THROW("Input generation key is nullptr");
+    if (capacity == 0) OPENFHE_THROW("Perturbation pool capacity must be positive");
+    m_SFDKBase->StartPerturbationPool(keyGen, capacity, numThreads);
+  }
+
+  virtual void StopPerturbationPool(KeyCipherGenKey<DCRTPoly> keyGen) const {
+    VerifySFDKEnabled(__func__);
+    if (!keyGen) OPENFHE_THROW("Input generation key is nullptr");
+    m_SFDKBase->StopPerturbationPool(keyGen);
+  }
+
+  virtual void ResetPRNGStream() const {
+    VerifySFDKEnabled(__func__);
+    m_SFDKBase->ResetPRNGStream();
+  }
+
   using SchemeBase::Encrypt;
   virtual Ciphertext<DCRTPoly> Encrypt(
       const DCRTPoly &plaintext, const PublicKeySFDK<DCRTPoly> publicKey) const {
@@ -166,6 +196,15 @@ class SchemeBFVRNSSFDK : public SchemeBFVRNS {
 
     return m_SFDKBase->Encrypt(plaintext, publicKey);
   }
+
+  virtual std::vector<Ciphertext<DCRTPoly>> EncryptBatch(
+      std::vector<DCRTPoly> plaintexts,
+      const PublicKeySFDK<DCRTPoly> publicKey) const {
+    VerifySFDKEnabled(__func__);
+    if (!publicKey) OPENFHE_THROW("Input public key is nullptr");
+
+    return m_SFDKBase->EncryptBatch(std::move(plaintexts), publicKey);
+  }
   using SchemeBase::Decrypt;
   virtual DecryptResult Decrypt(Ciphertext<DCRTPoly> &ciphertext,
                                 KeyCipher<DCRTPoly> &decKey,
@@ -178,6 +217,13 @@ class SchemeBFVRNSSFDK : public SchemeBFVRNS {
     return m_SFDKBase->Decrypt(ciphertext, decKey, publicKey, plaintext);
   }
 
+  virtual std::shared_ptr<SFDKDecryptor> MakeDecryptor(
+      PublicKeySFDK<DCRTPoly> publicKey) const {
+    VerifySFDKEnabled(__func__);
+    if (!publicKey) OPENFHE_THROW("Input public key is nullptr");
+    return std::make_shared<SFDKDecryptor>(publicKey);
+  }
+
   virtual Ciphertext<DCRTPoly> PrivateSetMembership(
       const Ciphertext<DCRTPoly> &ciphertext, const std::vector<int64_t> &testset,
       CryptoContextImplSFDK<DCRTPoly> *cryptoContext)  {
@@ -187,6 +233,24 @@ class SchemeBFVRNSSFDK : public SchemeBFVRNS {
     return m_SFDKBase->PrivateSetMembership(ciphertext, testset, cryptoContext);
   }
 
+  virtual Ciphertext<DCRTPoly> PrivateSetMembershipReplicated(
+      const Ciphertext<DCRTPoly> &ciphertext, const std::vector<int64_t> &testset,
+      CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+    VerifySFDKEnabled(__func__);
+    if (!ciphertext) OPENFHE_THROW("Input ciphertext is nullptr");
+
+    return m_SFDKBase->PrivateSetMembershipReplicated(ciphertext, testset,
+                                                      cryptoContext);
+  }
+  virtual Ciphertext<DCRTPoly> PrivateSetMembershipPacked(
+      const Ciphertext<DCRTPoly> &ciphertext, const std::vector<int64_t> &testset,
+      uint blockWidth, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+    VerifySFDKEnabled(__func__);
+    if (!ciphertext) OPENFHE_THROW("Input ciphertext is nullptr");
+
+    return m_SFDKBase->PrivateSetMembershipPacked(ciphertext, testset,
+                                                  blockWidth, cryptoContext);
+  }
   virtual Ciphertext<DCRTPoly> PrivateSetMembership(
       const Ciphertext<DCRTPoly> &ciphertext, uint start, uint size,
       CryptoContextImplSFDK<DCRTPoly> *cryptoContext)  {
@@ -197,6 +261,75 @@ class SchemeBFVRNSSFDK : public SchemeBFVRNS {
                                             cryptoContext);
   }
 
+  virtual Ciphertext<DCRTPoly> PrivateRangeMembership(
+      const Ciphertext<DCRTPoly> &ciphertext, uint64_t start, uint64_t size,
+      uint base, uint digits,
+      CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+    VerifySFDKEnabled(__func__);
+    if (!ciphertext) OPENFHE_THROW("Input ciphertext is nullptr");
+
+    return m_SFDKBase->PrivateRangeMembership(ciphertext, start, size, base,
+                                              digits, cryptoContext);
+  }
+
+  virtual void PrepareRangeMembership(
+      PrivateKey<DCRTPoly> secretKey, uint base, uint digits,
+      CryptoContextImplSFDK<DCRTPoly> *cryptoContext) {
+    VerifySFDKEnabled(__func__);
+    if (!secretKey) OPENFHE_THROW("Input private key is nullptr");
+    return m_SFDKBase->PrepareRangeMembership(secretKey, base, digits,
+                                              cryptoContext);
+  }
+
+  virtual Ciphertext<DCRTPoly> AggregateResults(
+      const std::vector<Ciphertext<DCRTPoly>> &results, bool mask,
+      CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+    VerifySFDKEnabled(__func__);
+    for (const auto &result : results) {
+      if (!result) OPENFHE_THROW("Input ciphertext is nullptr");
+    }
+
+    return m_SFDKBase->AggregateResults(results, mask, cryptoContext);
+  }
+
+  virtual void PrepareAggregation(
+      PrivateKey<DCRTPoly> secretKey, uint count,
+      CryptoContextImplSFDK<DCRTPoly> *cryptoContext) {
+    VerifySFDKEnabled(__func__);
+    if (!secretKey) OPENFHE_THROW("Input private key is nullptr");
+    return m_SFDKBase->PrepareAggregation(secretKey, count, cryptoContext);
+  }
+
+  virtual std::pair<PublicKeySFDK<DCRTPoly>, KeyCipherGenKey<DCRTPoly>>
+  GenReducedKeys(PublicKeySFDK<DCRTPoly> publicKey,
+                 KeyCipherGenKey<DCRTPoly> keyGen, uint towers) const {
+    VerifySFDKEnabled(__func__);
+    if (!publicKey) OPENFHE_THROW("Input public key is nullptr");
+    if (!keyGen) OPENFHE_THROW("Input key generator is nullptr");
+
+    return m_SFDKBase->GenReducedKeys(publicKey, keyGen, towers);
+  }
+
+  virtual Ciphertext<DCRTPoly> CompactResult(
+      ConstCiphertext<DCRTPoly> ciphertext, uint towers,
+      CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+    VerifySFDKEnabled(__func__);
+    if (!ciphertext) OPENFHE_THROW("Input ciphertext is nullptr");
+
+    return m_SFDKBase->CompactResult(ciphertext, towers, cryptoContext);
+  }
+
+  virtual Ciphertext<DCRTPoly> PrivateSetIntersectionCardinality(
+      const Ciphertext<DCRTPoly> &ciphertext, const std::vector<int64_t> &testset,
+      uint blockWidth, uint queries,
+      CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+    VerifySFDKEnabled(__func__);
+    if (!ciphertext) OPENFHE_THROW("Input ciphertext is nullptr");
+
+    return m_SFDKBase->PrivateSetIntersectionCardinality(
+        ciphertext, testset, blockWidth, queries, cryptoContext);
+  }
+
   virtual void PreparePSM(PrivateKey<DCRTPoly> secretKey, uint maxsize,
                           CryptoContextImplSFDK<DCRTPoly> *cryptoContext) {
     VerifySFDKEnabled(__func__);
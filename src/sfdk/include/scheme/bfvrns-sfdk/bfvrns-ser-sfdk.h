@@ -0,0 +1,31 @@
+//==================================================================================
+// Author Carlos Ribeiro
+//
+//==================================================================================
+
+/*
+  Serialization registrations of the SFDK context, parameters and scheme
+ */
+
+#ifndef LBCRYPTO_CRYPTO_BFVRNS_SFDK_SER_H
+#define LBCRYPTO_CRYPTO_BFVRNS_SFDK_SER_H
+
+#include "cryptocontext-ser.h"
+#include "key/key-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+
+#include "cryptocontext-sfdk.h"
+
+// Keys and ciphertexts store their context through a pointer to the base
+// CryptoContextImpl, so the SFDK types have to be known to cereal
+CEREAL_REGISTER_TYPE(lbcrypto::CryptoContextImplSFDK<lbcrypto::DCRTPoly>);
+CEREAL_REGISTER_POLYMORPHIC_RELATION(lbcrypto::CryptoContextImpl<lbcrypto::DCRTPoly>,
+                                     lbcrypto::CryptoContextImplSFDK<lbcrypto::DCRTPoly>);
+
+CEREAL_REGISTER_TYPE(lbcrypto::CryptoParametersBFVRNSSFDK);
+CEREAL_REGISTER_POLYMORPHIC_RELATION(lbcrypto::CryptoParametersBFVRNS, lbcrypto::CryptoParametersBFVRNSSFDK);
+
+CEREAL_REGISTER_TYPE(lbcrypto::SchemeBFVRNSSFDK);
+CEREAL_REGISTER_POLYMORPHIC_RELATION(lbcrypto::SchemeBFVRNS, lbcrypto::SchemeBFVRNSSFDK);
+
+#endif  // LBCRYPTO_CRYPTO_BFVRNS_SFDK_SER_H
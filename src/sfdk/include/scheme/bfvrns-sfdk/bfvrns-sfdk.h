@@ -9,8 +9,17 @@
 
 #include "openfhe.h"
 #include "cryptocontext-sfdk.h"
+#include "scheme/bfvrns-sfdk/bfvrns-cryptoparameters-sfdk.h"
+#include "scheme/bfvrns-sfdk/gadgetsampler-sfdk.h"
+#include "scheme/bfvrns-sfdk/prngstream-sfdk.h"
 
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 /**
  * @namespace lbcrypto
@@ -18,6 +27,26 @@
  */
 namespace lbcrypto {
 
+/**
+ * @brief Plan of the products computing x^exponent. Nodes 0..squarings are the
+ * squaring chain x^(2^i), at depth i; every product appends a node. The plan
+ * has the minimal multiplicative depth ceil(log2(exponent)).
+ */
+struct PowerCircuit {
+    // number of squarings of the chain
+    uint32_t squarings = 0;
+    // pairs of nodes multiplied, in evaluation order
+    std::vector<std::pair<size_t, size_t>> products;
+    // node holding x^exponent
+    size_t output = 0;
+    // multiplicative depth of the output
+    uint32_t depth = 0;
+
+    uint32_t GetMultCount() const {
+        return squarings + products.size();
+    }
+};
+
 class SFDKBFVRNS  {
     using ParmType = typename DCRTPoly::Params;
     using IntType  = typename DCRTPoly::Integer;
@@ -47,6 +76,64 @@ public:
    */
     KeyCipher<DCRTPoly> GenDecKeyFor(Ciphertext<DCRTPoly> &cipherText, KeyCipherGenKey<DCRTPoly> keyGen, PublicKeySFDK<DCRTPoly> publicKey) const ;
 
+    /**
+   * Function to generate decryption keys for a batch of ciphertexts. The
+   * setup is shared and the keys are sampled in parallel.
+   *
+   * @param &cipherTexts ciphertexts to generate the decryption keys for.
+   * @param &keyGen key generator used to generate the decryption keys.
+   * @param &publicKey public key of the ciphertexts.
+   * @return one decryption key per ciphertext, in the same order.
+   */
+    std::vector<KeyCipher<DCRTPoly>> GenDecKeysFor(std::vector<Ciphertext<DCRTPoly>> &cipherTexts, KeyCipherGenKey<DCRTPoly> keyGen, PublicKeySFDK<DCRTPoly> publicKey) const ;
+
+    /**
+   * Function to start precomputing trapdoor perturbations in the background.
+   * GenDecKeyFor takes them from the pool and only runs the online sampling.
+   *
+   * @param &keyGen key generator the perturbations are sampled for.
+   * @param capacity number of perturbations kept ready.
+   * @param numThreads number of background threads filling the pool.
+   */
+    void StartPerturbationPool(KeyCipherGenKey<DCRTPoly> keyGen, size_t capacity, usint numThreads) const ;
+
+    /**
+   * Function to stop the background threads of the perturbation pool
+   *
+   * @param &keyGen key generator holding the pool.
+   */
+    void StopPerturbationPool(KeyCipherGenKey<DCRTPoly> keyGen) const ;
+
+    /**
+   * Function to restart the random stream of a seeded context from its seed,
+   * so the next calls repeat the keys and encryptions made since the context
+   * was created. Does nothing for an unseeded context.
+   */
+    void ResetPRNGStream() const ;
+
+    /**
+   * Function to derive the public key and trapdoor of the first towers of the
+   * modulus. The one-time keys of results compacted to those towers are
+   * sampled and used with them, over the reduced towers only.
+   *
+   * @param &publicKey full public key.
+   * @param &keyGen key generator holding the full trapdoor.
+   * @param towers number of towers kept.
+   * @return the reduced public key and key generator.
+   */
+    std::pair<PublicKeySFDK<DCRTPoly>, KeyCipherGenKey<DCRTPoly>> GenReducedKeys(PublicKeySFDK<DCRTPoly> publicKey, KeyCipherGenKey<DCRTPoly> keyGen, uint towers) const ;
+
+    /**
+   * Function to switch a result down to the first towers of the modulus
+   * before its one-time key is generated
+   *
+   * @param &ciphertext the result to compact.
+   * @param towers number of towers kept.
+   * @param cryptoContext the crypto context.
+   * @return the compacted ciphertext.
+   */
+    Ciphertext<DCRTPoly> CompactResult(ConstCiphertext<DCRTPoly> ciphertext, uint towers, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
     /**
    * Method for encrypting plaintext using LBC
    *
@@ -59,6 +146,17 @@ public:
    */
     Ciphertext<DCRTPoly> Encrypt(DCRTPoly plaintext, const PublicKeySFDK<DCRTPoly> publicKey) const ;
 
+    /**
+   * Method for encrypting many plaintexts under the same public key. The
+   * scaling constants and the public key setup are shared by the batch and
+   * the items are encrypted in parallel.
+   *
+   * @param plaintexts copies of the plaintext elements.
+   * @param publicKey public key used for encryption.
+   * @return one ciphertext per plaintext, in the same order.
+   */
+    std::vector<Ciphertext<DCRTPoly>> EncryptBatch(std::vector<DCRTPoly> plaintexts, const PublicKeySFDK<DCRTPoly> publicKey) const ;
+
     /**
    * Method for decrypting plaintext using LBC
    *
@@ -72,16 +170,56 @@ public:
                                   Plaintext* plaintext) ;
 
 /**
- * @brief Method for testing if a ciphertext is a member of a set
+ * @brief Method for testing if a ciphertext is a member of a set. Sets larger
+ * than a slot row are split in chunks whose differences are multiplied in a
+ * balanced tree, see GetPSMDepth
  * 
  * @param ciphertext with the element to be tested
- * @param testset the set to be tested against
+ * @param testset the set to be tested against, of any size
  * @param cryptoContext the crypto context
  * @param secretKey the secret key
  * @return Ciphertext<DCRTPoly> 
  */
  Ciphertext<DCRTPoly> PrivateSetMembership(Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &testset, CryptoContextImplSFDK<DCRTPoly> *cryptoContext)  ;
    
+/**
+ * @brief Method for testing if a query is a member of a set when the client
+ * already encrypted the query in every slot, which skips the replication
+ * rotations. It needs the depth of GetPSMDepth with replicated set.
+ * 
+ * @param ciphertext with the element to be tested copied in every slot
+ * @param testset the set to be tested against
+ * @param cryptoContext the crypto context
+ * @return Ciphertext<DCRTPoly> 
+ */
+ Ciphertext<DCRTPoly> PrivateSetMembershipReplicated(Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &testset, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+/**
+ * @brief Method for testing many queries against the same set at once. The
+ * slots are split in blocks of blockWidth slots, query i is in the first slot
+ * of block i and its answer is returned in the same slot
+ * 
+ * @param ciphertext with one query at the start of every block
+ * @param testset the set to be tested against, at most blockWidth elements
+ * @param blockWidth power of two dividing half the ring dimension
+ * @param cryptoContext the crypto context
+ * @return Ciphertext<DCRTPoly> 
+ */
+ Ciphertext<DCRTPoly> PrivateSetMembershipPacked(Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &testset, uint blockWidth, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+/**
+ * @brief Method for counting how many of the queries packed in a ciphertext
+ * are in a set, so a single one-time key reveals only the count
+ * 
+ * @param ciphertext with one query at the start of every block
+ * @param testset the set to be tested against, at most blockWidth elements
+ * @param blockWidth power of two dividing half the ring dimension
+ * @param queries the number of queries, in the first slot row
+ * @param cryptoContext the crypto context
+ * @return Ciphertext<DCRTPoly> the number of matches in slot 0
+ */
+ Ciphertext<DCRTPoly> PrivateSetIntersectionCardinality(Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &testset, uint blockWidth, uint queries, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
 /**
  * @brief Method for testing if a ciphertext between two integers
  * 
@@ -94,6 +232,56 @@ public:
  */
  Ciphertext<DCRTPoly> PrivateSetMembership(Ciphertext<DCRTPoly> ciphertext, uint start, uint size, CryptoContextImplSFDK<DCRTPoly> *cryptoContext)  ;
 
+/**
+ * @brief Method for testing if a query is in [start, start+size) with a cost
+ * polylogarithmic in the size. The interval is covered by base-adic aligned
+ * blocks, each compared against the digits of the query in its own slots.
+ * 
+ * @param ciphertext with the digits of the query, see MakeDigitQuery
+ * @param start the lower bound of the interval
+ * @param size the size of the interval
+ * @param base the digit base, below the plaintext modulus
+ * @param digits the number of digits of the query
+ * @param cryptoContext the crypto context
+ * @return Ciphertext<DCRTPoly> 0 in slot 0 if in the interval, 1 otherwise
+ */
+ Ciphertext<DCRTPoly> PrivateRangeMembership(Ciphertext<DCRTPoly> ciphertext, uint64_t start, uint64_t size, uint base, uint digits, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+/**
+ * @brief Method to generate the rotation keys of PrivateRangeMembership
+ * 
+ * @param secretKey 
+ * @param base the digit base
+ * @param digits the number of digits of the queries
+ * @param cryptoContext 
+ */
+void PrepareRangeMembership(PrivateKey<DCRTPoly> secretKey, uint base, uint digits, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) ;
+
+/**
+ * @brief Merges membership results into one ciphertext, the answer of
+ * results[i] in slot i, so a single one-time key decrypts all of them
+ * 
+ * @param results ciphertexts with their answer in slot 0, at most half the
+ * ring dimension of them
+ * @param mask true to clear the other slots of the results first, which
+ * costs one level. PrivateSetMembership, PrivateSetMembershipReplicated,
+ * PrivateSetIntersectionCardinality and PrivateRangeMembership return them
+ * cleared; the results of PrivateSetMembershipPacked hold an answer at
+ * every block start and need the mask
+ * @param cryptoContext the crypto context
+ * @return Ciphertext<DCRTPoly> 
+ */
+ Ciphertext<DCRTPoly> AggregateResults(const std::vector<Ciphertext<DCRTPoly>> &results, bool mask, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+/**
+ * @brief Method to generate the rotation keys of AggregateResults
+ * 
+ * @param secretKey 
+ * @param count the number of results merged
+ * @param cryptoContext 
+ */
+void PrepareAggregation(PrivateKey<DCRTPoly> secretKey, uint count, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) ;
+
 /**
  * @brief Method to set the parameters for a Private Membership Test
  * 
@@ -138,6 +326,87 @@ Ciphertext<DCRTPoly> ScaleByBits(ConstCiphertext<DCRTPoly> ciphertext, usint bit
  */
   DCRTPoly GetDecryptionError(const PrivateKey<DCRTPoly> privateKey, Ciphertext<DCRTPoly> &ciphertext, Plaintext plaintext = NULL) const ;
 
+/**
+ * @brief Plans the power circuit of an exponent: the squaring chain of its
+ * highest bit, with the set bits combined shallowest first
+ * 
+ * @param exponent the exponent, at least 1
+ * @return PowerCircuit 
+ */
+  static PowerCircuit PlanPowerCircuit(uint64_t exponent) ;
+
+/**
+ * @brief Exact multiplicative depth of the membership tests for a plaintext
+ * modulus: the depth of x^(t-1) plus one level for the mask of the count, and
+ * ceil(log2(chunks)) levels for the product of the chunks of a large set. A
+ * query replicated by the client is masked before the power as well, which
+ * takes one more level.
+ * 
+ * @param plaintextModulus the plaintext modulus t
+ * @param chunks number of slot row sized chunks of the set
+ * @param replicated whether the test is PrivateSetMembershipReplicated
+ * @return uint32_t 
+ */
+  static uint32_t GetPSMDepth(PlaintextModulus plaintextModulus, uint32_t chunks = 1, bool replicated = false) ;
+
+/**
+ * @brief Plans the rotation indices a membership test of count slots uses:
+ * the replication of the query and the window sum of the count. Packed
+ * tests use the same indices as a single query.
+ * 
+ * @param count the set size, at most half the ring dimension
+ * @param replicate false when the client already replicated the query
+ * @return std::vector<int32_t> sorted rotation indices
+ */
+  static std::vector<int32_t> PlanPSMRotations(uint count, bool replicate = true) ;
+
+/**
+ * @brief Plans the rotation indices of PrivateSetIntersectionCardinality:
+ * those of a membership test and the sum of the blocks of a slot row
+ * 
+ * @param count the set size
+ * @param blockWidth the width of the slot blocks
+ * @param ringDimension the ring dimension
+ * @return std::vector<int32_t> sorted rotation indices
+ */
+  static std::vector<int32_t> PlanCardinalityRotations(uint count, uint blockWidth, uint ringDimension) ;
+
+/**
+ * @brief Plans the rotation indices of AggregateResults: -2^j below count
+ * 
+ * @param count the number of results merged
+ * @return std::vector<int32_t> sorted rotation indices
+ */
+  static std::vector<int32_t> PlanAggregateRotations(uint count) ;
+
+/**
+ * @brief Plans the rotation indices of PrivateRangeMembership
+ * 
+ * @param copies the number of digit blocks, a power of two
+ * @param width the width of a digit block
+ * @return std::vector<int32_t> sorted rotation indices
+ */
+  static std::vector<int32_t> PlanRangeRotations(uint copies, uint width) ;
+
+/**
+ * @brief Exact multiplicative depth of PrivateRangeMembership: the depth of
+ * x^(t-1), log2 of the digit block width and two plaintext masks
+ * 
+ * @param plaintextModulus the plaintext modulus t
+ * @param digits the number of digits of the queries
+ * @return uint32_t 
+ */
+  static uint32_t GetRangeDepth(PlaintextModulus plaintextModulus, uint digits) ;
+
+/**
+ * @brief Number of slots used by PrivateRangeMembership for any interval
+ * 
+ * @param base the digit base
+ * @param digits the number of digits of the queries
+ * @return uint 
+ */
+  static uint GetRangeSlots(uint base, uint digits) ;
+
     /////////////////////////////////////
     // SERIALIZATION
     /////////////////////////////////////
@@ -155,6 +424,125 @@ Ciphertext<DCRTPoly> ScaleByBits(ConstCiphertext<DCRTPoly> ciphertext, usint bit
     std::string SerializedObjectName() const {
         return "SFDKBFVRNS";
     }
+
+private:
+    // Number of query copies built from one hoisted rotation precomputation
+    static constexpr uint PSM_BABY_STEPS = 4;
+
+    /**
+   * Copies the query in slot 0 to the first count slots. The first rotations
+   * are hoisted over a single precomputation, the rest double the copies.
+   */
+    Ciphertext<DCRTPoly> ReplicateQuery(Ciphertext<DCRTPoly> ciphertext, uint count,
+                                        CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+    /**
+   * Subtracts every chunk of the set from the replicated query and multiplies
+   * the differences in a balanced tree. The chunks are evaluated in parallel.
+   */
+    Ciphertext<DCRTPoly> MultiplyChunkDifferences(Ciphertext<DCRTPoly> ciphertext, const std::vector<Plaintext> &chunks,
+                                                  CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+    /**
+   * Encodes the chunks of a set in parallel, padding a short chunk with the
+   * values of the first one.
+   */
+    std::vector<Plaintext> EncodeChunks(const std::vector<std::vector<int64_t>> &chunks,
+                                        CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+    /**
+   * Slots of the digit block of a range query: the smallest power of two
+   * holding the digits.
+   */
+    static uint GetRangeBlockWidth(uint digits) ;
+
+    /**
+   * Covers [start, start+size) with base-adic aligned blocks, as pairs of the
+   * first value of the block and the number of free low digits.
+   */
+    static std::vector<std::pair<uint64_t, uint>> DecomposeRange(uint64_t start, uint64_t size, uint base, uint digits) ;
+
+    /**
+   * Evaluates x^exponent following the planned power circuit
+   */
+    Ciphertext<DCRTPoly> EvalPower(Ciphertext<DCRTPoly> ciphertext, const PowerCircuit &circuit,
+                                   CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+    /**
+   * Subtracts the set from the packed queries replicated in their blocks.
+   */
+    Ciphertext<DCRTPoly> ComparePacked(Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &testset, uint blockWidth,
+                                       CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+    /**
+   * Maps every slot to 0 if zero and 1 otherwise, and adds the first count
+   * slots of every window of the next power of two slots into its first one.
+   */
+    Ciphertext<DCRTPoly> SumNonZero(Ciphertext<DCRTPoly> ciphertext, uint count,
+                                    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const ;
+
+    /**
+   * Maps every slot to 0 if zero and 1 otherwise, and returns the number of
+   * non zero slots among the first count minus count-1 in slot 0, or in the
+   * first slot of every block when blockWidth is set.
+   */
+    Ciphertext<DCRTPoly> CountNonZero(Ciphertext<DCRTPoly> ciphertext, uint count,
+                                      CryptoContextImplSFDK<DCRTPoly> *cryptoContext, uint blockWidth = 0) const ;
+
+    /**
+   * Trapdoor generation with the uniform column of the public matrix
+   * expanded from a seed when one is given, and the lowest droppedDigits
+   * digits left out of the gadget. With a stream, column i of the trapdoor
+   * draws from its fork i.
+   */
+    std::pair<Matrix<DCRTPoly>, RLWETrapdoorPair<DCRTPoly>> SFDKTrapdoorGen(
+        const std::shared_ptr<ParmType> &params, double stddev, int64_t base, const std::array<uint32_t, 8> *seed,
+        size_t droppedDigits, const PRNGStreamSFDK *stream = nullptr) const ;
+
+    /**
+   * Samples the decryption key for the second component of a ciphertext,
+   * using a precomputed perturbation when the key generator has one.
+   */
+    Matrix<DCRTPoly> SampleDecKey(const DCRTPoly &c1, const Matrix<DCRTPoly> &A, const KeyCipherGenKey<DCRTPoly> &keyGen,
+                                  DggType &dgg, DggType &dggLargeSigma, size_t n, size_t k, size_t base) const ;
+
+    /**
+   * Covariance terms a, b and d of the perturbation sampling of a trapdoor,
+   * in EVALUATION format. They only depend on the trapdoor, so key generation
+   * computes them once and keeps them in the key generator.
+   */
+    static std::vector<Field2n> PerturbationFactors(const RLWETrapdoorPair<DCRTPoly> &trapdoor, size_t n, size_t base) ;
+
+    /**
+   * Samples a perturbation vector for the trapdoor, as
+   * RLWETrapdoorUtility::GaussSampOffline, from its precomputed covariance
+   * terms. Empty terms are computed for this call.
+   */
+    static std::shared_ptr<Matrix<DCRTPoly>> SamplePerturbation(const RLWETrapdoorPair<DCRTPoly> &trapdoor,
+                                                                const std::vector<Field2n> &factors, DggType &dgg,
+                                                                DggType &dggLargeSigma, size_t n, size_t base) ;
+
+    /**
+   * Returns the RNS gadget sampler of the element parameters, building its
+   * tables on first use, or nullptr when the base is not supported.
+   */
+    std::shared_ptr<GadgetSamplerSFDK> GetGadgetSampler(const std::shared_ptr<ParmType> &params, size_t base,
+                                                        size_t k) const ;
+
+    /**
+   * Stream of the next call of a seeded context, drawn from the stream of the
+   * context, or nullptr when the context uses the global generator. Calls
+   * made in the same order get the same streams.
+   */
+    std::unique_ptr<PRNGStreamSFDK> NextPRNGStream(const CryptoParametersBFVRNSSFDK &cryptoParams) const ;
+
+    // gadget samplers by number of towers, base and number of digits
+    mutable std::map<std::array<size_t, 3>, std::shared_ptr<GadgetSamplerSFDK>> m_gadgetSamplers;
+    mutable std::mutex m_gadgetSamplersMutex;
+
+    // random stream of a seeded context, started on first use
+    mutable std::unique_ptr<PRNGStreamSFDK> m_prngStream;
+    mutable std::mutex m_prngStreamMutex;
 };
 }  // namespace lbcrypto
 
@@ -0,0 +1,114 @@
+//==================================================================================
+// Author Carlos Ribeiro
+//
+//==================================================================================
+
+/*
+  RNS-native sampler of the gadget lattice used for the one-time keys
+ */
+
+#ifndef LBCRYPTO_CRYPTO_BFVRNS_SFDK_GADGETSAMPLER_H
+#define LBCRYPTO_CRYPTO_BFVRNS_SFDK_GADGETSAMPLER_H
+
+#include "openfhe.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @namespace lbcrypto
+ * The namespace of lbcrypto
+ */
+namespace lbcrypto {
+
+/**
+ * @brief Gadget lattice sampler for the power-of-two bases of SFDK.
+ *
+ * Implements the arbitrary modulus G-sampling of Genise-Micciancio (as
+ * LatticeGaussSampUtility::GaussSampGqArbBase) without leaving the RNS
+ * representation: the base-b digits of every syndrome coefficient are
+ * reconstructed from its residues with word-size limbs, and the sampling
+ * tables of the modulus are computed once, when the sampler is built.
+ */
+class GadgetSamplerSFDK {
+    using ParmType = typename DCRTPoly::Params;
+    using DggType  = typename DCRTPoly::DggType;
+
+public:
+    /**
+     * @brief Precomputes the digit reconstruction and sampling tables
+     *
+     * @param params the element parameters of the keys
+     * @param base the gadget base, a power of two
+     * @param k the number of gadget digits
+     */
+    GadgetSamplerSFDK(const std::shared_ptr<ParmType> &params, uint64_t base, size_t k);
+
+    /**
+     * @brief Whether the sampler handles a base; other bases use the generic
+     * trapdoor sampler
+     */
+    static bool Supports(uint64_t base, size_t k);
+
+    /**
+     * @brief Samples a preimage of u for the public matrix A, as
+     * RLWETrapdoorUtility::GaussSampOnline. When A has fewer gadget digits
+     * than the sampler, it is an approximate trapdoor keeping the highest
+     * ones, and A maps the preimage to u up to the dropped low digits.
+     *
+     * @param A the public matrix
+     * @param T the trapdoor of A
+     * @param u the syndrome, in EVALUATION format
+     * @param dgg the discrete Gaussian generator
+     * @param perturbation the perturbation vector of the preimage
+     * @return the preimage, in EVALUATION format
+     */
+    Matrix<DCRTPoly> GaussSampOnline(const Matrix<DCRTPoly> &A, const RLWETrapdoorPair<DCRTPoly> &T, const DCRTPoly &u,
+                                     DggType &dgg, const std::shared_ptr<Matrix<DCRTPoly>> &perturbation) const;
+
+    /**
+     * @brief Samples z with sum_t base^t z(t, j) = u[j] mod q for every
+     * coefficient j of u
+     *
+     * @param u the syndrome, in COEFFICIENT format
+     * @param dgg the discrete Gaussian generator
+     * @param z the k x n matrix of the gadget digits
+     */
+    void SampleGq(const DCRTPoly &u, DggType &dgg, Matrix<int64_t> *z) const;
+
+    size_t GetNumOfTowers() const {
+        return m_moduli.size();
+    }
+
+private:
+    // Writes the base-b digits of the coefficient j of u
+    void Digits(const DCRTPoly &u, size_t j, std::vector<int64_t> &acc, int64_t *digits) const;
+
+    uint64_t m_base;
+    uint32_t m_logBase;
+    size_t m_k;
+    // base-b chunks of a word-size residue
+    size_t m_chunks;
+    // limbs of the digit reconstruction
+    size_t m_limbs;
+
+    std::vector<NativeInteger> m_moduli;
+    // [(q/q_i)^-1]_{q_i} and its precomputation for ModMulFastConst
+    std::vector<NativeInteger> m_qHatInvModq;
+    std::vector<NativeInteger> m_qHatInvModqPrecon;
+    // base-b digits of q/q_i, and 1/q_i
+    std::vector<std::vector<int64_t>> m_qHatDigits;
+    std::vector<double> m_qInv;
+    // base-b digits of q
+    std::vector<int64_t> m_qDigits;
+
+    // Gaussian parameter and tables of the perturbation and of SampleC
+    double m_sigma;
+    std::vector<double> m_l;
+    std::vector<double> m_h;
+    std::vector<double> m_d;
+};
+
+}  // namespace lbcrypto
+#endif  // LBCRYPTO_CRYPTO_BFVRNS_SFDK_GADGETSAMPLER_H
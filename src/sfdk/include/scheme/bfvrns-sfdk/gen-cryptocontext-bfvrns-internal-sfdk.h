@@ -16,8 +16,13 @@
 #include "pke/scheme/scheme-utils.h"
 #include "pke/scheme/scheme-id.h"
 #include "cryptocontextfactory-sfdk.h"
+#include "math/dgsampling.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include <utility>
 
 namespace lbcrypto {
 
@@ -31,49 +36,141 @@ typename ContextGeneratorType::ContextType genCryptoContextBFVRNSSFDKInternal(
     using ParmType                   = typename Element::Params;
     constexpr float assuranceMeasure = 36.0f;
 
-    auto ep = std::make_shared<ParmType>();
     EncodingParams encodingParams(
         std::make_shared<EncodingParamsImpl>(parameters.GetPlaintextModulus(), parameters.GetBatchSize()));
 
-    // clang-format off
-    auto params = std::make_shared<typename ContextGeneratorType::CryptoParams>(
-        ep,
-        encodingParams,
-        parameters.GetStandardDeviation(),
-        assuranceMeasure,
-        parameters.GetSecurityLevel(),
-        parameters.GetDigitSize(),
-        parameters.GetSecretKeyDist(),
-        parameters.GetMaxRelinSkDeg(),
-        parameters.GetKeySwitchTechnique(),
-        parameters.GetScalingTechnique(),
-        parameters.GetEncryptionTechnique(),
-        parameters.GetMultiplicationTechnique(),
-        parameters.GetPREMode(),
-        parameters.GetMultipartyMode(),
-        parameters.GetExecutionMode(),
-        parameters.GetDecryptionNoiseMode(),
-        parameters.GetPlaintextModulus(),
-        parameters.GetStatisticalSecurity(),
-        parameters.GetNumAdversarialQueries(),
-        parameters.GetThresholdNumOfParties(),
-        parameters.GetBase(),
-        parameters.GetVerifyNorm());
-
-    // for BFV scheme noise scale is always set to 1
-    params->SetNoiseScale(1);
-
-    auto scheme = std::make_shared<typename ContextGeneratorType::PublicKeyEncryptionScheme>();
-    scheme->SetKeySwitchingTechnique(parameters.GetKeySwitchTechnique());
-    scheme->ParamsGenBFVRNS(
-        params,
-        parameters.GetEvalAddCount(),
-        parameters.GetMultiplicativeDepth(),
-        parameters.GetKeySwitchCount(),
-        parameters.GetScalingModSize(),
-        parameters.GetRingDim(),
-        parameters.GetNumLargeDigits());
-    // clang-format on
+    uint32_t evalAddCount        = parameters.GetEvalAddCount();
+    uint32_t multiplicativeDepth = parameters.GetMultiplicativeDepth();
+
+    auto generate = [&]() {
+        auto ep = std::make_shared<ParmType>();
+        // clang-format off
+        auto params = std::make_shared<typename ContextGeneratorType::CryptoParams>(
+            ep,
+            encodingParams,
+            parameters.GetStandardDeviation(),
+            assuranceMeasure,
+            parameters.GetSecurityLevel(),
+            parameters.GetDigitSize(),
+            parameters.GetSecretKeyDist(),
+            parameters.GetMaxRelinSkDeg(),
+            parameters.GetKeySwitchTechnique(),
+            parameters.GetScalingTechnique(),
+            parameters.GetEncryptionTechnique(),
+            parameters.GetMultiplicationTechnique(),
+            parameters.GetPREMode(),
+            parameters.GetMultipartyMode(),
+            parameters.GetExecutionMode(),
+            parameters.GetDecryptionNoiseMode(),
+            parameters.GetPlaintextModulus(),
+            parameters.GetStatisticalSecurity(),
+            parameters.GetNumAdversarialQueries(),
+            parameters.GetThresholdNumOfParties(),
+            parameters.GetBase(),
+            parameters.GetVerifyNorm(),
+            parameters.GetSeededPublicKey(),
+            parameters.GetApproxTrapdoorDigits(),
+            parameters.GetPRNGSeed());
+
+        // for BFV scheme noise scale is always set to 1
+        params->SetNoiseScale(1);
+
+        auto scheme = std::make_shared<typename ContextGeneratorType::PublicKeyEncryptionScheme>();
+        scheme->SetKeySwitchingTechnique(parameters.GetKeySwitchTechnique());
+        scheme->ParamsGenBFVRNS(
+            params,
+            evalAddCount,
+            multiplicativeDepth,
+            parameters.GetKeySwitchCount(),
+            parameters.GetScalingModSize(),
+            parameters.GetRingDim(),
+            parameters.GetNumLargeDigits());
+        // clang-format on
+        return std::make_pair(params, scheme);
+    };
+    auto generated = generate();
+
+    // With an approximate trapdoor the one-time key decryption adds s times
+    // the dropped digits of the preimage, |sum_{t<l} base^t z_t| with the
+    // G-samples z_t below sqrt(alpha) (base+1) SIGMA. That noise is added once,
+    // after the computation, so the modulus only grows when the slack between
+    // it and the BFV bound of ParamsGenBFVRNS cannot hold it.
+    const uint32_t droppedDigits = parameters.GetApproxTrapdoorDigits();
+    if (droppedDigits > 0) {
+        if (multiplicativeDepth == 0 && parameters.GetKeySwitchCount() > 0) {
+            OPENFHE_THROW(config_error, "The approximate trapdoor cannot be sized for a key switching count");
+        }
+        const double p         = parameters.GetPlaintextModulus();
+        const double base      = parameters.GetBase();
+        const double sqrtAlpha = std::sqrt(assuranceMeasure);
+        const double Berr      = sqrtAlpha * parameters.GetStandardDeviation();
+        const double Bkey      = parameters.GetSecretKeyDist() == GAUSSIAN ? Berr : 1;
+        const double logBerr   = std::log2(sqrtAlpha * (base + 1) * SIGMA) + (droppedDigits - 1) * std::log2(base) +
+                               std::log2(base / (base - 1));
+        auto logq = [](const decltype(generated)& g) -> double {
+            return std::log2(g.first->GetElementParams()->GetModulus().ConvertToDouble());
+        };
+        auto delta = [](const decltype(generated)& g) -> double {
+            return 2 * std::sqrt(g.first->GetElementParams()->GetRingDimension());
+        };
+        // log2 of the modulus ParamsGenBFVRNS requires for the computation,
+        // p (4 V + p) with V the noise bound of the circuit. The circuit is the
+        // one of the parameters, whatever the budget grows to below.
+        const uint32_t sizedDepth    = multiplicativeDepth;
+        const uint32_t sizedAddCount = evalAddCount;
+        auto logBFV = [&](const decltype(generated)& g) -> double {
+            const double d     = delta(g);
+            const double vNorm = Berr * (1 + 2 * d * Bkey);
+            if (sizedDepth == 0) {
+                return std::log2(p * (4 * ((sizedAddCount + 1) * vNorm + sizedAddCount) + p));
+            }
+            const auto& cp = g.first;
+            double noiseKS;
+            if (cp->GetKeySwitchTechnique() == HYBRID) {
+                noiseKS = (cp->GetNumPartQ() * d * Berr + d * Bkey + 1) / 2;
+            }
+            else {
+                const double logw = cp->GetDigitSize() == 0 ?
+                                        cp->GetElementParams()->GetParams()[0]->GetModulus().GetMSB() :
+                                        cp->GetDigitSize();
+                noiseKS = d * cp->GetElementParams()->GetParams().size() * std::exp2(logw) * Berr;
+            }
+            const double c1    = d * d * p * Bkey;
+            const double c2    = d * d * Bkey * Bkey / 2 + noiseKS;
+            const double depth = sizedDepth;
+            return std::log2(
+                p * (4 * (vNorm * std::pow(c1, depth) + depth * std::pow(c1, depth - 1) * c2) + p));
+        };
+        // log2 of 4t times the approximate trapdoor noise, with the expansion
+        // factor 2 sqrt(n)
+        auto logNoise = [&](const decltype(generated)& g) -> double {
+            return std::log2(4.0 * p) + std::log2(delta(g) * Bkey) + logBerr;
+        };
+        // Both noises fit when q is above the sum of their bounds
+        auto logNeeded = [&](const decltype(generated)& g) -> double {
+            const double a = logBFV(g);
+            const double b = logNoise(g);
+            return std::max(a, b) + std::log2(1 + std::exp2(-std::abs(a - b)));
+        };
+
+        // The budget grows with the number of additions when only those are
+        // counted, else with the depth
+        while (logq(generated) < logNeeded(generated)) {
+            if (multiplicativeDepth == 0 && evalAddCount > 0) {
+                if (evalAddCount > std::numeric_limits<uint32_t>::max() / 2) {
+                    OPENFHE_THROW(config_error, "The approximate trapdoor drops too many digits");
+                }
+                evalAddCount = 2 * evalAddCount + 1;
+            }
+            else {
+                multiplicativeDepth++;
+            }
+            generated = generate();
+        }
+    }
+
+    auto params = generated.first;
+    auto scheme = generated.second;
     //std::shared_ptr<CryptoContextImpl<DCRTPoly>> cc = CryptoContextFactorySFDK<Element>::GetContext(params, scheme);
     auto cc = ContextGeneratorType::Factory::GetContext(params, scheme);
     cc->setSchemeId(SCHEME::BFVRNS_SCHEME);
@@ -0,0 +1,106 @@
+//==================================================================================
+// Author Carlos Ribeiro
+//
+//==================================================================================
+
+/*
+  Seeded random stream for reproducible key generation and encryption
+ */
+
+#ifndef LBCRYPTO_CRYPTO_BFVRNS_SFDK_PRNGSTREAM_H
+#define LBCRYPTO_CRYPTO_BFVRNS_SFDK_PRNGSTREAM_H
+
+#include "openfhe.h"
+#include "utils/prng/blake2engine.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @namespace lbcrypto
+ * The namespace of lbcrypto
+ */
+namespace lbcrypto {
+
+/**
+ * @brief Deterministic Blake2 stream replacing the global generator of
+ * OpenFHE when a context is seeded.
+ *
+ * Every sample only depends on the seed of the stream and on the samples
+ * drawn before it. Fork derives an independent stream from an index, so
+ * parallel loops give each iteration its own stream and the result does not
+ * depend on the number of threads or on their scheduling.
+ */
+class PRNGStreamSFDK {
+    using ParmType = typename DCRTPoly::Params;
+
+public:
+    using Seed = std::array<uint32_t, 8>;
+
+    explicit PRNGStreamSFDK(const Seed &seed);
+
+    /**
+     * @brief Stream of a 64-bit context seed
+     */
+    explicit PRNGStreamSFDK(uint64_t seed);
+
+    /**
+     * @brief Independent stream, only depending on the seed of this stream
+     * and on the index. It does not advance this stream.
+     */
+    PRNGStreamSFDK Fork(uint64_t index) const;
+
+    /**
+     * @brief Draws the seed of a new stream, advancing this one
+     */
+    Seed NextSeed();
+
+    uint64_t NextWord();
+
+    /**
+     * @brief Uniform double in [0, 1)
+     */
+    double NextDouble();
+
+    /**
+     * @brief Discrete Gaussian integer, by rejection sampling within
+     * TAIL standard deviations of the mean
+     */
+    int64_t GaussianInteger(double mean, double stddev);
+
+    /**
+     * @brief Polynomial with discrete Gaussian coefficients
+     */
+    DCRTPoly Gaussian(const std::shared_ptr<ParmType> &params, double stddev, Format format);
+
+    /**
+     * @brief Polynomial with uniform ternary coefficients, as the ternary
+     * generator of OpenFHE without a Hamming weight
+     */
+    DCRTPoly Ternary(const std::shared_ptr<ParmType> &params, Format format);
+
+    /**
+     * @brief Polynomial uniform modulo every tower, in EVALUATION format
+     */
+    DCRTPoly Uniform(const std::shared_ptr<ParmType> &params);
+
+    const Seed &GetSeed() const {
+        return m_seed;
+    }
+
+    // Width of the rejection sampling, in standard deviations
+    static constexpr double TAIL = 12.0;
+
+private:
+    // Polynomial with the same small coefficients in every tower
+    static DCRTPoly FromIntegers(const std::vector<int64_t> &values, const std::shared_ptr<ParmType> &params,
+                                 Format format);
+
+    Seed m_seed;
+    std::unique_ptr<default_prng::Blake2Engine> m_engine;
+};
+
+}  // namespace lbcrypto
+#endif  // LBCRYPTO_CRYPTO_BFVRNS_SFDK_PRNGSTREAM_H
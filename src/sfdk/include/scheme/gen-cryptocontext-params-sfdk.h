@@ -19,6 +19,12 @@ class ParamsSFDK : public Params {
     uint32_t m_base;
     //flag for verifying norm of trapdoor
     bool VerifyNorm;
+    //flag for expanding the uniform part of the public key from a seed
+    bool SeededPublicKey;
+    //number of low gadget digits left out of the trapdoor
+    uint32_t ApproxTrapdoorDigits;
+    //seed of the random stream of the context, 0 for the global generator
+    uint64_t PRNGSeed;
 
 protected:
     // How to disable a particular setter for a particular scheme and get an exception thrown if a user tries to call it:
@@ -61,6 +67,18 @@ public:
         return VerifyNorm;
     }
 
+    bool GetSeededPublicKey() const {
+        return SeededPublicKey;
+    }
+
+    uint32_t GetApproxTrapdoorDigits() const {
+        return ApproxTrapdoorDigits;
+    }
+
+    uint64_t GetPRNGSeed() const {
+        return PRNGSeed;
+    }
+
     // setters
     // They all must be virtual, so any of them can be disabled in the derived class
     virtual void SetBase(uint32_t base0) {
@@ -71,10 +89,33 @@ public:
         VerifyNorm = verifyNorm0;
     }
 
+    virtual void SetSeededPublicKey(bool seededPublicKey0) {
+        SeededPublicKey = seededPublicKey0;
+    }
+
+    // Approximate trapdoor: the lowest digits of the gadget are left out of
+    // the public key, shrinking it, the encryption vector and the one-time keys
+    // by as many columns, at the cost of extra decryption noise
+    virtual void SetApproxTrapdoorDigits(uint32_t approxTrapdoorDigits0) {
+        ApproxTrapdoorDigits = approxTrapdoorDigits0;
+    }
+
+    // Seeded context: key generation and encryption draw from a stream of
+    // this seed instead of the global generator, so they are reproducible.
+    // FOR TESTS AND BENCHMARKS ONLY, the seed determines the secret keys.
+    // GenCryptoContext returns the existing context of equal parameters, so
+    // the keys are only repeated in the same process after ResetPRNGStream.
+    virtual void SetPRNGSeed(uint64_t prngSeed0) {
+        PRNGSeed = prngSeed0;
+    }
+
     void SetSDKDefaults() {
         Params::SetSecretKeyDist(GAUSSIAN);
         m_base                        = 2; 
         VerifyNorm                  = false;
+        SeededPublicKey             = false;
+        ApproxTrapdoorDigits        = 0;
+        PRNGSeed                    = 0;
     }
 
     friend std::ostream& operator<<(std::ostream& os, const ParamsSFDK& obj);
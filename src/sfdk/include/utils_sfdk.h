@@ -2,69 +2,384 @@
 #define SRC_SFDK_SFDKUTILS_H_
 
 #include "openfhe.h"
+#include "utils/prng/blake2engine.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <utility>
+#include <vector>
 
 namespace lbcrypto {
 class SdfkUtils  {
  public:
 
+ /**
+  * @brief Inner product of two vectors of DCRTPolys stored as 1xk or kx1
+  * matrices. The matrices are read in place, each thread accumulates a
+  * partial sum and the partial sums are combined with a tree reduction.
+  *
+  * @param _a first vector, in EVALUATION format
+  * @param _b second vector, in EVALUATION format
+  * @return DCRTPoly the sum of _a[i]*_b[i]
+  */
  static DCRTPoly dotProd(const Matrix<DCRTPoly> &_a, const Matrix<DCRTPoly> &_b) {
-    std::vector<std::vector<DCRTPoly>> a = _a.GetData();
-    std::vector<std::vector<DCRTPoly>> b = _b.GetData();
-    if(a.size() == 0 || b.size() == 0) {
+    if(_a.GetRows() == 0 || _a.GetCols() == 0 || _b.GetRows() == 0 || _b.GetCols() == 0) {
         OPENFHE_THROW(config_error,"First or Second DCRTPolys is empty");
     }
+    if((_a.GetRows() != 1 && _a.GetCols() != 1) || (_b.GetRows() != 1 && _b.GetCols() != 1)) {
+        OPENFHE_THROW(config_error,"First or Second DCRTPoly is not a vector");
+    }
+    const bool aIsRow{_a.GetRows() == 1};
+    const bool bIsRow{_b.GetRows() == 1};
+    const size_t size{aIsRow ? _a.GetCols() : _a.GetRows()};
+    if(size != (bIsRow ? _b.GetCols() : _b.GetRows())) {
+        OPENFHE_THROW(config_error,"Vectors are not of the same size");
+    }
 
-    DCRTPoly result = a[0][0]*b[0][0];
-    if(a.size() == 1 && b.size() == 1) {
-        if(a[0].size() != b[0].size()) {
-            OPENFHE_THROW(config_error,"Vectors are not of the same size");
+    auto at = [](const Matrix<DCRTPoly> &m, bool isRow, size_t i) -> const DCRTPoly & {
+        return isRow ? m(0, i) : m(i, 0);
+    };
+
+    // every entry is checked here, as an exception must not leave the
+    // parallel region below
+    const DCRTPoly &a0 = at(_a, aIsRow, 0);
+    const size_t towers{a0.GetNumOfElements()};
+    for(size_t i = 0; i < size; i++) {
+        const DCRTPoly &a = at(_a, aIsRow, i);
+        const DCRTPoly &b = at(_b, bIsRow, i);
+        if(a.GetFormat() != Format::EVALUATION || b.GetFormat() != Format::EVALUATION) {
+            OPENFHE_THROW(config_error,"Inner product requires DCRTPolys in EVALUATION format");
         }
-        size_t size{a[0].size()};
-#pragma omp parallel for // reduction(+:result) //num_threads(OpenFHEParallelControls.GetThreadLimit(size))        
-        for(usint i=1; i<size; i++) {
-            auto x = a[0][i]*b[0][i];
-#pragma omp critical
-            result += x;
+        if(a.GetNumOfElements() != towers || b.GetNumOfElements() != towers) {
+            OPENFHE_THROW(config_error,"DCRTPolys do not have the same number of towers");
         }
-    } else if(a[0].size() == 1 && b[0].size() == 1) {
-        if(a.size() != b.size()) {
-            OPENFHE_THROW(config_error,"Vectors are not of the same size");
+    }
+
+    // modulus and Barrett constant of every tower, shared by all threads
+    std::vector<NativeInteger> moduli(towers), mus(towers);
+    for(size_t j = 0; j < towers; j++) {
+        moduli[j] = a0.GetElementAtIndex(j).GetModulus();
+        mus[j]    = moduli[j].ComputeMu();
+    }
+
+    const size_t nThreads{std::max<size_t>(1, std::min<size_t>(size, OpenFHEParallelControls.GetThreadLimit(size)))};
+    std::vector<DCRTPoly> partial(nThreads);
+
+#pragma omp parallel for num_threads(nThreads) schedule(static, 1)
+    for(size_t t = 0; t < nThreads; t++) {
+        const size_t begin{t * size / nThreads};
+        const size_t end{(t + 1) * size / nThreads};
+        DCRTPoly acc = at(_a, aIsRow, begin) * at(_b, bIsRow, begin);
+        for(size_t i = begin + 1; i < end; i++) {
+            MulAccumulate(acc, at(_a, aIsRow, i), at(_b, bIsRow, i), moduli, mus);
         }
-        size_t size{a.size()};
-#pragma omp parallel for //reduction(+:result) //num_threads(OpenFHEParallelControls.GetThreadLimit(size))
-        for(usint i=1; i<size; i++) {
-            auto x = a[i][0]*b[i][0];
-#pragma omp critical
-            result += x;
+        partial[t] = std::move(acc);
+    }
+
+    // pairwise tree reduction of the per-thread partial sums
+    for(size_t stride = 1; stride < nThreads; stride <<= 1) {
+#pragma omp parallel for num_threads(nThreads)
+        for(size_t t = 0; t < nThreads - stride; t += 2 * stride) {
+            partial[t] += partial[t + stride];
         }
-    } else if(a.size() == 1 && b[0].size() == 1) {
-        if(a[0].size() != b.size()) {
-            OPENFHE_THROW(config_error,"Vectors are not of the same size");
+    }
+
+    return std::move(partial[0]);
+ }
+
+ /**
+  * @brief Inner product of two vectors of DCRTPolys with lazy reduction.
+  * The products of every RNS limb and coefficient are accumulated in 128 bits
+  * and reduced only when the accumulator could overflow and once at the end,
+  * so no temporary DCRTPoly is allocated per term. Falls back to dotProd
+  * when 128-bit integers are not available.
+  *
+  * @param _a first vector, in EVALUATION format
+  * @param _b second vector, in EVALUATION format
+  * @return DCRTPoly the sum of _a[i]*_b[i]
+  */
+ static DCRTPoly lazyDotProd(const Matrix<DCRTPoly> &_a, const Matrix<DCRTPoly> &_b) {
+#if defined(HAVE_INT128) && NATIVEINT == 64
+    return std::move(lazyInnerProducts({vectorEntries(_a)}, vectorEntries(_b))[0]);
+#else
+    return dotProd(_a, _b);
+#endif
+ }
+
+ /**
+  * @brief Two inner products sharing the right operand, <_a0,_u> and <_a1,_u>,
+  * computed in a single sweep over _u.
+  *
+  * @param _a0 first left vector, in EVALUATION format
+  * @param _a1 second left vector, in EVALUATION format
+  * @param _u shared right vector, in EVALUATION format
+  * @return std::pair<DCRTPoly, DCRTPoly> the two inner products
+  */
+ static std::pair<DCRTPoly, DCRTPoly> fusedDotProd(const Matrix<DCRTPoly> &_a0, const Matrix<DCRTPoly> &_a1,
+                                                   const Matrix<DCRTPoly> &_u) {
+#if defined(HAVE_INT128) && NATIVEINT == 64
+    auto r = lazyInnerProducts({vectorEntries(_a0), vectorEntries(_a1)}, vectorEntries(_u));
+    return {std::move(r[0]), std::move(r[1])};
+#else
+    return {dotProd(_a0, _u), dotProd(_a1, _u)};
+#endif
+ }
+
+ /**
+  * @brief Expands a 32-byte seed into a DCRTPoly uniform over every RNS
+  * tower, directly in EVALUATION format. Each tower draws from its own
+  * Blake2 stream and uses rejection sampling, so the result only depends
+  * on the seed and the element parameters.
+  *
+  * @param seed the 32-byte seed
+  * @param params element parameters of the polynomial
+  * @return DCRTPoly the expanded polynomial
+  */
+ static DCRTPoly expandUniform(const std::array<uint32_t, 8> &seed, const std::shared_ptr<DCRTPoly::Params> &params) {
+    DCRTPoly result(params, Format::EVALUATION, true);
+    auto &towers = result.GetAllElements();
+
+#pragma omp parallel for num_threads(OpenFHEParallelControls.GetThreadLimit(towers.size()))
+    for(size_t j = 0; j < towers.size(); j++) {
+        std::array<uint32_t, 16> streamSeed{};
+        std::copy(seed.begin(), seed.end(), streamSeed.begin());
+        streamSeed[8] = static_cast<uint32_t>(j);
+        default_prng::Blake2Engine prng(streamSeed);
+
+        const uint64_t q{towers[j].GetModulus().ConvertToInt<uint64_t>()};
+        const uint32_t bits{towers[j].GetModulus().GetMSB()};
+        const uint64_t mask{bits >= 64 ? std::numeric_limits<uint64_t>::max() : (uint64_t(1) << bits) - 1};
+        const usint ringDim{towers[j].GetRingDimension()};
+        for(usint c = 0; c < ringDim; c++) {
+            uint64_t v;
+            do {
+                const uint64_t hi{prng()};
+                const uint64_t lo{prng()};
+                v = ((hi << 32) | lo) & mask;
+            } while(v >= q);
+            towers[j][c] = NativeInteger(v);
+        }
+    }
+    return result;
+ }
+
+ /**
+  * @brief Packs a vector of DCRTPolys with small coefficients, stored as a
+  * kx1 or 1xk matrix, as the zigzag LEB128 varints of their centered
+  * coefficients, entry after entry. Every tower must hold the same centered
+  * value, which is read from the first one.
+  *
+  * @param m the vector, in any format
+  * @return std::vector<uint8_t> the packed coefficients
+  */
+ static std::vector<uint8_t> packSmall(const Matrix<DCRTPoly> &m) {
+    Matrix<DCRTPoly> coefficients = m;
+    coefficients.SetFormat(Format::COEFFICIENT);
+
+    std::vector<uint8_t> out;
+    for(const DCRTPoly *element : vectorEntries(coefficients)) {
+        const auto &towers = element->GetAllElements();
+        const NativeInteger &q0 = towers[0].GetModulus();
+        const NativeInteger half = q0 >> 1;
+        const usint ringDim{element->GetRingDimension()};
+        for(usint c = 0; c < ringDim; c++) {
+            const NativeInteger &r = towers[0][c];
+            const bool negative{r > half};
+            const NativeInteger magnitude = negative ? q0 - r : r;
+            for(size_t j = 1; j < towers.size(); j++) {
+                const NativeInteger &qj = towers[j].GetModulus();
+                const NativeInteger reduced = magnitude.Mod(qj);
+                if(towers[j][c] != (negative ? qj.ModSub(reduced, qj) : reduced)) {
+                    OPENFHE_THROW(serialize_error, "Coefficients are too large to be packed");
+                }
+            }
+            const uint64_t m64{magnitude.ConvertToInt<uint64_t>()};
+            uint64_t z{negative ? 2 * m64 - 1 : 2 * m64};
+            while(z >= 0x80) {
+                out.push_back(static_cast<uint8_t>(z) | 0x80);
+                z >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(z));
+        }
+    }
+    return out;
+ }
+
+ /**
+  * @brief Unpacks the output of packSmall into a kx1 vector of DCRTPolys.
+  *
+  * @param packed the packed coefficients
+  * @param rows the number of entries of the vector
+  * @param params element parameters of the entries
+  * @return Matrix<DCRTPoly> the vector, in EVALUATION format
+  */
+ static Matrix<DCRTPoly> unpackSmall(const std::vector<uint8_t> &packed, size_t rows,
+                                     const std::shared_ptr<DCRTPoly::Params> &params) {
+    const usint ringDim{params->GetRingDimension()};
+    Matrix<int64_t> values([]() { return 0; }, rows, ringDim);
+    size_t pos{0};
+    for(size_t i = 0; i < rows; i++) {
+        for(usint c = 0; c < ringDim; c++) {
+            uint64_t z{0};
+            for(uint32_t shift = 0;; shift += 7) {
+                if(pos == packed.size() || shift > 63) {
+                    OPENFHE_THROW(deserialize_error, "Packed coefficients are truncated or corrupted");
+                }
+                const uint8_t byte{packed[pos++]};
+                // The tenth byte only holds the top bit of the word
+                if(shift == 63 && byte > 1) {
+                    OPENFHE_THROW(deserialize_error, "Packed coefficients are truncated or corrupted");
+                }
+                z |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if(!(byte & 0x80)) break;
+            }
+            values(i, c) = (z & 1) ? -static_cast<int64_t>(z >> 1) - 1 : static_cast<int64_t>(z >> 1);
         }
-        size_t size{a[0].size()};
-#pragma omp parallel for // reduction(+:result) //num_threads(OpenFHEParallelControls.GetThreadLimit(size))
-        for(usint i=1; i<size; i++) {
-            auto x = a[0][i]*b[i][0];
-#pragma omp critical
-            result += x;
+    }
+    if(pos != packed.size()) {
+        OPENFHE_THROW(deserialize_error, "Packed coefficients have trailing bytes");
+    }
+
+    Matrix<DCRTPoly> result = SplitInt64AltIntoElements<DCRTPoly>(values, ringDim, params);
+    result.SetFormat(Format::EVALUATION);
+    return result;
+ }
+
+ private:
+
+ /**
+  * @brief Pointers to the entries of a 1xk or kx1 matrix of DCRTPolys in
+  * EVALUATION format.
+  */
+ static std::vector<const DCRTPoly *> vectorEntries(const Matrix<DCRTPoly> &m) {
+    if(m.GetRows() == 0 || m.GetCols() == 0) {
+        OPENFHE_THROW(config_error,"First or Second DCRTPolys is empty");
+    }
+    if(m.GetRows() != 1 && m.GetCols() != 1) {
+        OPENFHE_THROW(config_error,"First or Second DCRTPoly is not a vector");
+    }
+    const bool isRow{m.GetRows() == 1};
+    std::vector<const DCRTPoly *> v(isRow ? m.GetCols() : m.GetRows());
+    for(size_t i = 0; i < v.size(); i++) {
+        v[i] = isRow ? &m(0, i) : &m(i, 0);
+        if(v[i]->GetFormat() != Format::EVALUATION) {
+            OPENFHE_THROW(config_error,"Inner product requires DCRTPolys in EVALUATION format");
         }
-    } else if(a[0].size() == 1 && b.size() == 1) {
-        if(a[0].size() != b.size()) {
+    }
+    return v;
+ }
+
+#if defined(HAVE_INT128) && NATIVEINT == 64
+ /**
+  * @brief Lazy 128-bit kernel computing <lhs[l],rhs> for every l. Every
+  * coefficient of rhs is read once for all the left operands.
+  */
+ static std::vector<DCRTPoly> lazyInnerProducts(const std::vector<std::vector<const DCRTPoly *>> &lhs,
+                                                const std::vector<const DCRTPoly *> &rhs) {
+    const size_t size{rhs.size()};
+    const size_t towers{rhs[0]->GetNumOfElements()};
+    for(const auto &a : lhs) {
+        if(a.size() != size) {
             OPENFHE_THROW(config_error,"Vectors are not of the same size");
         }
-        size_t size{a.size()};
-#pragma omp parallel for // reduction(+:result) //num_threads(OpenFHEParallelControls.GetThreadLimit(size))
-        for(usint i=1; i<size; i++) {
-            auto x = a[i][0]*b[0][i];
-#pragma omp critical
-            result += x;
+    }
+    for(size_t i = 0; i < size; i++) {
+        bool sameTowers{rhs[i]->GetNumOfElements() == towers};
+        for(const auto &a : lhs) {
+            sameTowers = sameTowers && a[i]->GetNumOfElements() == towers;
         }
-    } else {
-        OPENFHE_THROW(config_error,"First or Second DCRTPoly is not a vector");
+        if(!sameTowers) {
+            OPENFHE_THROW(config_error,"DCRTPolys do not have the same number of towers");
+        }
+    }
+
+    // the accumulators of a coefficient live on the stack
+    constexpr size_t MAX_LHS{2};
+    const size_t nl{lhs.size()};
+    if(nl == 0 || nl > MAX_LHS) {
+        OPENFHE_THROW(config_error,"Lazy inner products take one or two left operands");
     }
+    std::vector<DCRTPoly> result(nl, DCRTPoly(rhs[0]->GetParams(), Format::EVALUATION, true));
+    const usint ringDim{rhs[0]->GetRingDimension()};
+
+    for(size_t j = 0; j < towers; j++) {
+        const NativeInteger q{rhs[0]->GetElementAtIndex(j).GetModulus()};
+        const NativeInteger mu{q.ComputeMu()};
+        const uint64_t qv{q.ConvertToInt<uint64_t>()};
+        // 2^64 mod q, used to fold the high word of the accumulator
+        const NativeInteger r64{(std::numeric_limits<uint64_t>::max() % qv + 1) % qv};
+        // products are below q^2, so after a reduction to [0,q) another
+        // floor(2^64/q)-1 products keep the high word below q
+        const size_t budget{std::max<size_t>(1, std::numeric_limits<uint64_t>::max() / qv - 1)};
+
+        std::vector<const NativeVector *> y(size);
+        std::vector<std::vector<const NativeVector *>> x(nl, std::vector<const NativeVector *>(size));
+        for(size_t i = 0; i < size; i++) {
+            y[i] = &rhs[i]->GetElementAtIndex(j).GetValues();
+            for(size_t l = 0; l < nl; l++) {
+                x[l][i] = &lhs[l][i]->GetElementAtIndex(j).GetValues();
+            }
+        }
+        std::vector<NativePoly *> z(nl);
+        for(size_t l = 0; l < nl; l++) {
+            z[l] = &result[l].GetAllElements()[j];
+        }
 
+        auto reduce = [&](DoubleNativeInt acc) -> NativeInteger {
+            NativeInteger hi{static_cast<uint64_t>(acc >> 64)};
+            NativeInteger lo{static_cast<uint64_t>(acc)};
+            // Barrett needs an input below q^2, which the low word is not for
+            // small moduli
+            return hi.ModMulFast(r64, q, mu).ModAddFast(lo.Mod(q), q);
+        };
+
+#pragma omp parallel for num_threads(OpenFHEParallelControls.GetThreadLimit(ringDim))
+        for(usint c = 0; c < ringDim; c++) {
+            DoubleNativeInt acc[MAX_LHS]{};
+            size_t pending{0};
+            for(size_t i = 0; i < size; i++) {
+                const DoubleNativeInt yc{(*y[i])[c].ConvertToInt<uint64_t>()};
+                for(size_t l = 0; l < nl; l++) {
+                    acc[l] += yc * (*x[l][i])[c].ConvertToInt<uint64_t>();
+                }
+                if(++pending == budget) {
+                    for(size_t l = 0; l < nl; l++) {
+                        acc[l] = reduce(acc[l]).ConvertToInt<uint64_t>();
+                    }
+                    pending = 0;
+                }
+            }
+            for(size_t l = 0; l < nl; l++) {
+                (*z[l])[c] = reduce(acc[l]);
+            }
+        }
+    }
     return result;
  }
+#endif
+
+
+ /**
+  * @brief acc += a*b computed coefficient by coefficient on each RNS limb,
+  * without allocating a temporary DCRTPoly for the product. The caller
+  * checks that a and b have one tower per modulus.
+  */
+ static void MulAccumulate(DCRTPoly &acc, const DCRTPoly &a, const DCRTPoly &b,
+                           const std::vector<NativeInteger> &moduli, const std::vector<NativeInteger> &mus) {
+    auto &accTowers = acc.GetAllElements();
+    for(size_t j = 0; j < moduli.size(); j++) {
+        const auto &x = a.GetElementAtIndex(j);
+        const auto &y = b.GetElementAtIndex(j);
+        auto &z = accTowers[j];
+        const NativeInteger &q  = moduli[j];
+        const NativeInteger &mu = mus[j];
+        const usint ringDim{z.GetRingDimension()};
+        for(usint c = 0; c < ringDim; c++) {
+            z[c].ModAddFastEq(x[c].ModMulFast(y[c], q, mu), q);
+        }
+    }
+ }
 };
 }
-#endif // SRC_SFDK_SFDKUTILS_H_
\ No newline at end of file
+#endif // SRC_SFDK_SFDKUTILS_H_
@@ -0,0 +1,116 @@
+#include "scheme/bfvrns-sfdk/bfvrns-decryptor-sfdk.h"
+#include "utils_sfdk.h"
+
+/**
+ * @namespace lbcrypto
+ * The namespace of lbcrypto
+ */
+namespace lbcrypto {
+
+SFDKDecryptor::SFDKDecryptor(const PublicKeySFDK<DCRTPoly> publicKey) {
+  if (publicKey == nullptr) {
+    OPENFHE_THROW(config_error, "Input public key is nullptr");
+  }
+  m_cryptoParams = std::static_pointer_cast<CryptoParametersBFVRNSSFDK>(
+      publicKey->GetCryptoParameters());
+  m_encodingParams = m_cryptoParams->GetEncodingParams();
+  m_plaintextParams = std::make_shared<typename NativePoly::Params>(
+      m_cryptoParams->GetElementParams()->GetCyclotomicOrder(),
+      m_encodingParams->GetPlaintextModulus(), 1);
+
+  m_b = publicKey->GetLargePublicElements()[0];
+  m_b.SetFormat(Format::EVALUATION);
+}
+
+DecryptResult SFDKDecryptor::Decrypt(const Ciphertext<DCRTPoly> &ciphertext,
+                                     const KeyCipher<DCRTPoly> &decKey,
+                                     Plaintext *plaintext) const {
+  if (ciphertext == nullptr) {
+    OPENFHE_THROW(config_error, "Input ciphertext is nullptr");
+  }
+  if (decKey == nullptr) {
+    OPENFHE_THROW(config_error, "Input decryption key is nullptr");
+  }
+
+  const std::vector<DCRTPoly> &c = ciphertext->GetElements();
+
+  DCRTPoly r = c[0];
+  r.SetFormat(Format::EVALUATION);
+
+  // The key is only read; a key held in COEFFICIENT format is converted on a
+  // copy so concurrent decryptions never change shared state
+  const Matrix<DCRTPoly> &zHat = *decKey->getPrivateElement();
+  if (zHat(0, 0).GetFormat() == Format::EVALUATION) {
+    r -= SdfkUtils::lazyDotProd(m_b, zHat);
+  } else {
+    Matrix<DCRTPoly> zHatEval = zHat;
+    zHatEval.SetFormat(Format::EVALUATION);
+    r -= SdfkUtils::lazyDotProd(m_b, zHatEval);
+  }
+
+  // the plaintext params only depend on the ring, so they are reused unless
+  // the ciphertext was produced in a different ring
+  auto vp = m_plaintextParams;
+  if (c[0].GetParams()->GetCyclotomicOrder() !=
+      m_plaintextParams->GetCyclotomicOrder()) {
+    vp = std::make_shared<typename NativePoly::Params>(
+        c[0].GetParams()->GetCyclotomicOrder(),
+        m_encodingParams->GetPlaintextModulus(), 1);
+  }
+  Plaintext decrypted = PlaintextFactory::MakePlaintext(
+      ciphertext->GetEncodingType(), vp, m_encodingParams);
+
+  DecryptResult result =
+      ScaleAndRound(r, &decrypted->GetElement<NativePoly>(), m_cryptoParams);
+  decrypted->Decode();
+
+  if (result.isValid == false) return result;
+
+  *plaintext = std::move(decrypted);
+
+  return result;
+}
+
+DecryptResult SFDKDecryptor::ScaleAndRound(
+    DCRTPoly &b, NativePoly *plaintext,
+    const std::shared_ptr<CryptoParametersBFVRNSSFDK> &cryptoParams) {
+  b.SetFormat(Format::COEFFICIENT);
+  if (b.GetNumOfElements() !=
+      cryptoParams->GetElementParams()->GetParams().size()) {
+    // Compacted results have only a few towers, which the precomputed RNS
+    // tables do not cover: round t*x/q on the interpolated coefficients
+    const BigInteger &q = b.GetParams()->GetModulus();
+    const BigInteger t(cryptoParams->GetPlaintextModulus());
+    const BigInteger half = q >> 1;
+    Poly interpolated = b.CRTInterpolate();
+    NativePoly result(plaintext->GetParams(), Format::COEFFICIENT, true);
+    for (usint i = 0; i < interpolated.GetLength(); i++) {
+      BigInteger rounded = (interpolated[i] * t + half) / q;
+      result[i] = NativeInteger(rounded.Mod(t).ConvertToInt());
+    }
+    *plaintext = std::move(result);
+    return DecryptResult(plaintext->GetLength());
+  }
+  if (cryptoParams->GetMultiplicationTechnique() == HPS ||
+      cryptoParams->GetMultiplicationTechnique() == HPSPOVERQ ||
+      cryptoParams->GetMultiplicationTechnique() == HPSPOVERQLEVELED) {
+    *plaintext = b.ScaleAndRound(cryptoParams->GetPlaintextModulus(),
+                                 cryptoParams->GettQHatInvModqDivqModt(),
+                                 cryptoParams->GettQHatInvModqDivqModtPrecon(),
+                                 cryptoParams->GettQHatInvModqBDivqModt(),
+                                 cryptoParams->GettQHatInvModqBDivqModtPrecon(),
+                                 cryptoParams->GettQHatInvModqDivqFrac(),
+                                 cryptoParams->GettQHatInvModqBDivqFrac());
+  } else {
+    *plaintext = b.ScaleAndRound(
+        cryptoParams->GetModuliQ(), cryptoParams->GetPlaintextModulus(),
+        cryptoParams->Gettgamma(), cryptoParams->GettgammaQHatInvModq(),
+        cryptoParams->GettgammaQHatInvModqPrecon(),
+        cryptoParams->GetNegInvqModtgamma(),
+        cryptoParams->GetNegInvqModtgammaPrecon());
+  }
+
+  return DecryptResult(plaintext->GetLength());
+}
+
+}  // namespace lbcrypto
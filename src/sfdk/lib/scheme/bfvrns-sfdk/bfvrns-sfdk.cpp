@@ -1,7 +1,16 @@
 #include "scheme/bfvrns-sfdk/bfvrns-cryptoparameters-sfdk.h"
 #include "cryptocontext-sfdk.h"
+#include "scheme/bfvrns-sfdk/bfvrns-decryptor-sfdk.h"
 #include "utils_sfdk.h"
 
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <set>
+
 /**
  * @namespace lbcrypto
  * The namespace of lbcrypto
@@ -29,19 +38,44 @@ KeyPairSFDK<DCRTPoly> lbcrypto::SFDKBFVRNS::KeyGenInternal(
 
   auto stddev = dgg.GetStd();
 
-  // Generate trapdoor based using parameters and
+  // A seeded context draws the seed and the secret from the stream of this
+  // call, and every column of the keys from a fork of it
+  std::unique_ptr<PRNGStreamSFDK> stream = NextPRNGStream(*cryptoParams);
+
+  // Generate trapdoor based using parameters and. In seeded mode the uniform
+  // column of the trapdoor matrix is expanded from a seed kept in the key
+  std::array<uint32_t, 8> seed{};
+  if (stream != nullptr) {
+    seed = stream->NextSeed();
+  } else if (cryptoParams->GetSeededPublicKey()) {
+    std::random_device rd;
+    for (auto &w : seed) w = rd();
+  }
+  // An approximate trapdoor leaves the lowest gadget digits out of the key
+  const usint droppedDigits = cryptoParams->GetApproxTrapdoorDigits();
+  if (droppedDigits > 0 &&
+      !GadgetSamplerSFDK::Supports(base, droppedDigits + 2)) {
+    OPENFHE_THROW(config_error,
+                  "The approximate trapdoor needs a power of two base of at "
+                  "most 2^24");
+  }
+  // The trapdoor is sampled column by column in parallel, already in
+  // EVALUATION format
+  std::unique_ptr<PRNGStreamSFDK> trapdoorStream;
+  if (stream != nullptr) {
+    trapdoorStream = std::make_unique<PRNGStreamSFDK>(stream->Fork(0));
+  }
   std::pair<Matrix<DCRTPoly>, RLWETrapdoorPair<DCRTPoly>> keyPair =
-      RLWETrapdoorUtility<DCRTPoly>::TrapdoorGen(elementParams, stddev, base);
+      SFDKTrapdoorGen(elementParams, stddev, base,
+                      cryptoParams->GetSeededPublicKey() || stream != nullptr
+                          ? &seed
+                          : nullptr,
+                      droppedDigits, trapdoorStream.get());
   usint k = keyPair.first.GetData()[0].size();
   cryptoParams->SetK(k);
-  // elementParams->SetK(keyPair.first.GetData()[0].size());
-  //  Format of vectors are changed to prevent complications in calculations
-  keyPair.second.m_e.SetFormat(Format::EVALUATION);
-  keyPair.second.m_r.SetFormat(Format::EVALUATION);
 
   Matrix<DCRTPoly> &a = keyPair.first;
 
-  a.SetFormat(Format::EVALUATION);
   // Generate the secret key
   DCRTPoly s;
 
@@ -49,7 +83,11 @@ KeyPairSFDK<DCRTPoly> lbcrypto::SFDKBFVRNS::KeyGenInternal(
   // Supports both discrete Gaussian (RLWE) and ternary uniform distribution
   // (OPTIMIZED) cases
 
-  if (cryptoParams->GetSecretKeyDist() == GAUSSIAN) {
+  if (stream != nullptr) {
+    s = cryptoParams->GetSecretKeyDist() == GAUSSIAN
+            ? stream->Gaussian(elementParams, stddev, Format::COEFFICIENT)
+            : stream->Ternary(elementParams, Format::COEFFICIENT);
+  } else if (cryptoParams->GetSecretKeyDist() == GAUSSIAN) {
     s = DCRTPoly(dgg, elementParams, Format::COEFFICIENT);
   } else {
     s = DCRTPoly(tug, elementParams, Format::COEFFICIENT, 0);
@@ -59,23 +97,31 @@ KeyPairSFDK<DCRTPoly> lbcrypto::SFDKBFVRNS::KeyGenInternal(
   kp.secretKey->SetPrivateElement(s);
 
   auto zero_alloc = DCRTPoly::Allocator(elementParams, EVALUATION);
-  auto gaussian_alloc = DCRTPoly::MakeDiscreteGaussianCoefficientAllocator(
-      elementParams, Format::COEFFICIENT, dgg.GetStd());
-  // Done in two steps not to use a discrete Gaussian polynomial from a
-  // pre-computed pool
-  Matrix<DCRTPoly> e(zero_alloc, 1, k, gaussian_alloc);
-  // DCRTPoly e(dgg, elementParams, Format::COEFFICIENT,elementParams->GetK());
-  e.SetFormat(Format::EVALUATION);
+  Matrix<DCRTPoly> e(zero_alloc, 1, k);
+  Matrix<DCRTPoly> b(zero_alloc, 1, k);
+
+  // b = -(e + a s), the columns are independent. Each sample is done in two
+  // steps not to use a discrete Gaussian polynomial from a pre-computed pool
+#pragma omp parallel for schedule(dynamic)
+  for (usint j = 0; j < k; j++) {
+    if (stream != nullptr) {
+      e(0, j) = stream->Fork(j + 1).Gaussian(elementParams, stddev,
+                                             Format::EVALUATION);
+    } else {
+      e(0, j) = DCRTPoly(dgg, elementParams, Format::COEFFICIENT);
+      e(0, j).SetFormat(Format::EVALUATION);
+    }
+    b(0, j) -= e(0, j);
+    b(0, j) -= a(0, j) * s;
+  }
   kp.publicKey->m_error = e;
   kp.publicKey->m_s = s;
 
-  Matrix<DCRTPoly> b(zero_alloc, 1, k);
-  // DCRTPoly b(elementParams, Format::EVALUATION, true, elementParams->GetK());
-  b -= e;
-  b -= (a * s);
-
   kp.publicKey->SetLargePublicElementAtIndex(0, std::move(b));
   kp.publicKey->SetLargePublicElementAtIndex(1, std::move(a));
+  if (cryptoParams->GetSeededPublicKey()) {
+    kp.publicKey->SetSeed(seed);
+  }
 
   // Signing key will contain public key matrix of the trapdoor and the trapdoor
   // matrices
@@ -86,10 +132,322 @@ KeyPairSFDK<DCRTPoly> lbcrypto::SFDKBFVRNS::KeyGenInternal(
   kp.publicKey->SetKeyTag(kp.secretKey->GetKeyTag());
   kp.cipherKeyGen->SetPrivateElement(
       std::make_shared<RLWETrapdoorPair<DCRTPoly>>(keyPair.second));
+  kp.cipherKeyGen->SetPerturbationFactors(PerturbationFactors(
+      keyPair.second, elementParams->GetRingDimension(), base));
 
   return kp;
 }
 
+std::pair<Matrix<DCRTPoly>, RLWETrapdoorPair<DCRTPoly>>
+lbcrypto::SFDKBFVRNS::SFDKTrapdoorGen(
+    const std::shared_ptr<ParmType> &params, double stddev, int64_t base,
+    const std::array<uint32_t, 8> *seed, size_t droppedDigits,
+    const PRNGStreamSFDK *stream) const {
+  // Same construction as RLWETrapdoorUtility::TrapdoorGen, parallel over the
+  // columns. The uniform polynomial a may be expanded from a seed instead of
+  // drawn from the global generator, so it can be rebuilt from the seed
+  // alone, and the gadget may start at base^droppedDigits
+  auto zero_alloc = DCRTPoly::Allocator(params, Format::EVALUATION);
+  DggType dgg(stddev);
+
+  double val = params->GetModulus().ConvertToDouble();
+  double nBits = floor(log2(val - 1.0) + 1.0);
+  size_t digits = std::ceil(nBits / log2(base));
+  if (droppedDigits + 2 > digits) {
+    OPENFHE_THROW(config_error,
+                  "The approximate trapdoor must keep at least two digits");
+  }
+  size_t k = digits - droppedDigits;
+
+  DCRTPoly a;
+  if (seed != nullptr) {
+    a = SdfkUtils::expandUniform(*seed, params);
+  } else {
+    DugType dug;
+    a = DCRTPoly(dug, params, Format::EVALUATION);
+  }
+
+  Matrix<DCRTPoly> g =
+      Matrix<DCRTPoly>(zero_alloc, 1, digits).GadgetVector(base);
+
+  Matrix<DCRTPoly> r(zero_alloc, 1, k);
+  Matrix<DCRTPoly> e(zero_alloc, 1, k);
+  Matrix<DCRTPoly> A(zero_alloc, 1, k + 2);
+  A(0, 0) = 1;
+  A(0, 1) = a;
+
+  // The columns are independent: each one samples its pair of the trapdoor
+  // and is switched to EVALUATION format on its own thread
+#pragma omp parallel for schedule(dynamic)
+  for (size_t i = 0; i < k; ++i) {
+    if (stream != nullptr) {
+      PRNGStreamSFDK column = stream->Fork(i);
+      r(0, i) = column.Gaussian(params, stddev, Format::EVALUATION);
+      e(0, i) = column.Gaussian(params, stddev, Format::EVALUATION);
+    } else {
+      r(0, i) = DCRTPoly(dgg, params, Format::COEFFICIENT);
+      e(0, i) = DCRTPoly(dgg, params, Format::COEFFICIENT);
+      r(0, i).SetFormat(Format::EVALUATION);
+      e(0, i).SetFormat(Format::EVALUATION);
+    }
+    A(0, i + 2) = g(0, i + droppedDigits) - (a * r(0, i) + e(0, i));
+  }
+
+  return std::pair<Matrix<DCRTPoly>, RLWETrapdoorPair<DCRTPoly>>(
+      A, RLWETrapdoorPair<DCRTPoly>(r, e));
+}
+
+Matrix<DCRTPoly> lbcrypto::SFDKBFVRNS::SampleDecKey(
+    const DCRTPoly &c1, const Matrix<DCRTPoly> &A,
+    const KeyCipherGenKey<DCRTPoly> &keyGen, DggType &dgg,
+    DggType &dggLargeSigma, size_t n, size_t k, size_t base) const {
+  if (c1.GetNumOfElements() != A(0, 0).GetNumOfElements()) {
+    OPENFHE_THROW(config_error,
+                  "The ciphertext and the key have different numbers of "
+                  "towers, compacted results need the keys of GenReducedKeys");
+  }
+  DCRTPoly u = c1;
+  u.SetFormat(Format::EVALUATION);
+
+  // Use a precomputed perturbation if there is one ready, so only the
+  // G-lattice sampling of the syndrome is left on the online path
+  std::shared_ptr<Matrix<DCRTPoly>> perturbation = nullptr;
+  auto pool = keyGen->GetPerturbationPool();
+  if (pool != nullptr) {
+    perturbation = pool->Take();
+  }
+
+  const RLWETrapdoorPair<DCRTPoly> &trapdoor = *keyGen->GetPrivateElement();
+  // The G-sampling of an approximate trapdoor covers the dropped digits too
+  const size_t droppedDigits =
+      std::static_pointer_cast<CryptoParametersBFVRNSSFDK>(
+          keyGen->GetCryptoParameters())
+          ->GetApproxTrapdoorDigits();
+  auto sampler = GetGadgetSampler(u.GetParams(), base, k - 2 + droppedDigits);
+  if (sampler == nullptr && droppedDigits > 0) {
+    OPENFHE_THROW(config_error,
+                  "The approximate trapdoor needs a power of two base of at "
+                  "most 2^24");
+  }
+
+  if (perturbation == nullptr) {
+    perturbation =
+        SamplePerturbation(trapdoor, keyGen->GetPerturbationFactors(), dgg,
+                           dggLargeSigma, n, base);
+  }
+  if (sampler == nullptr) {
+    return RLWETrapdoorUtility<DCRTPoly>::GaussSampOnline(
+        n, k - 2, A, trapdoor, u, dgg, perturbation, base);
+  }
+  // The G-lattice sampling stays in RNS with the tables of the sampler
+  return sampler->GaussSampOnline(A, trapdoor, u, dgg, perturbation);
+}
+
+std::shared_ptr<GadgetSamplerSFDK> lbcrypto::SFDKBFVRNS::GetGadgetSampler(
+    const std::shared_ptr<ParmType> &params, size_t base, size_t k) const {
+  if (!GadgetSamplerSFDK::Supports(base, k)) {
+    return nullptr;
+  }
+  const std::array<size_t, 3> key{params->GetParams().size(), base, k};
+  std::lock_guard<std::mutex> lock(m_gadgetSamplersMutex);
+  auto &sampler = m_gadgetSamplers[key];
+  if (sampler == nullptr) {
+    sampler = std::make_shared<GadgetSamplerSFDK>(params, base, k);
+  }
+  return sampler;
+}
+
+std::unique_ptr<PRNGStreamSFDK> lbcrypto::SFDKBFVRNS::NextPRNGStream(
+    const CryptoParametersBFVRNSSFDK &cryptoParams) const {
+  if (cryptoParams.GetPRNGSeed() == 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(m_prngStreamMutex);
+  if (m_prngStream == nullptr) {
+    m_prngStream = std::make_unique<PRNGStreamSFDK>(cryptoParams.GetPRNGSeed());
+  }
+  return std::make_unique<PRNGStreamSFDK>(m_prngStream->NextSeed());
+}
+
+void lbcrypto::SFDKBFVRNS::ResetPRNGStream() const {
+  // The stream restarts from the seed on its next use
+  std::lock_guard<std::mutex> lock(m_prngStreamMutex);
+  m_prngStream = nullptr;
+}
+
+std::vector<Field2n> lbcrypto::SFDKBFVRNS::PerturbationFactors(
+    const RLWETrapdoorPair<DCRTPoly> &trapdoor, size_t n, size_t base) {
+  // Same terms as RLWETrapdoorUtility::ZSampleSigmaP, with the widths of
+  // GaussSampOffline
+  const Matrix<DCRTPoly> &e = trapdoor.m_e;
+  const Matrix<DCRTPoly> &r = trapdoor.m_r;
+  const size_t k = e.GetCols();
+  const double c = (base + 1) * SIGMA;
+  const double s = SPECTRAL_BOUND(n, k, base);
+
+  const auto params = e(0, 0).GetParams();
+  DCRTPoly va(params, Format::EVALUATION, true);
+  DCRTPoly vb(params, Format::EVALUATION, true);
+  DCRTPoly vd(params, Format::EVALUATION, true);
+  for (size_t i = 0; i < k; i++) {
+    va += e(0, i) * e(0, i).Transpose();
+    vb += r(0, i) * e(0, i).Transpose();
+    vd += r(0, i) * r(0, i).Transpose();
+  }
+  va.SetFormat(Format::COEFFICIENT);
+  vb.SetFormat(Format::COEFFICIENT);
+  vd.SetFormat(Format::COEFFICIENT);
+
+  const double scalarFactor = -s * s * c * c / (s * s - c * c);
+  Field2n a = Field2n(va.CRTInterpolate()).ScalarMult(scalarFactor) + s * s;
+  Field2n b = Field2n(vb.CRTInterpolate()).ScalarMult(scalarFactor);
+  Field2n d = Field2n(vd.CRTInterpolate()).ScalarMult(scalarFactor) + s * s;
+  a.SetFormat(Format::EVALUATION);
+  b.SetFormat(Format::EVALUATION);
+  d.SetFormat(Format::EVALUATION);
+  return {std::move(a), std::move(b), std::move(d)};
+}
+
+std::shared_ptr<Matrix<DCRTPoly>> lbcrypto::SFDKBFVRNS::SamplePerturbation(
+    const RLWETrapdoorPair<DCRTPoly> &trapdoor,
+    const std::vector<Field2n> &factors, DggType &dgg, DggType &dggLargeSigma,
+    size_t n, size_t base) {
+  if (factors.empty()) {
+    return SamplePerturbation(trapdoor, PerturbationFactors(trapdoor, n, base),
+                              dgg, dggLargeSigma, n, base);
+  }
+
+  // RLWETrapdoorUtility::ZSampleSigmaP with the covariance terms given
+  const Matrix<DCRTPoly> &e = trapdoor.m_e;
+  const Matrix<DCRTPoly> &r = trapdoor.m_r;
+  const size_t k = e.GetCols();
+  const double c = (base + 1) * SIGMA;
+  const double s = SPECTRAL_BOUND(n, k, base);
+  const auto params = e(0, 0).GetParams();
+
+  Matrix<int64_t> p2ZVector([]() { return 0; }, n * k, 1);
+  const double sigmaLarge = std::sqrt(s * s - c * c);
+  if (sigmaLarge > KARNEY_THRESHOLD) {
+    for (size_t i = 0; i < n * k; i++) {
+      p2ZVector(i, 0) = dgg.GenerateIntegerKarney(0, sigmaLarge);
+    }
+  } else {
+    std::shared_ptr<int64_t> dggVector = dggLargeSigma.GenerateIntVector(n * k);
+    for (size_t i = 0; i < n * k; i++) {
+      p2ZVector(i, 0) = dggVector.get()[i];
+    }
+  }
+  Matrix<DCRTPoly> p2 = SplitInt64IntoElements<DCRTPoly>(p2ZVector, n, params);
+  p2.SwitchFormat();
+
+  auto zero_alloc = DCRTPoly::Allocator(params, Format::EVALUATION);
+  Matrix<DCRTPoly> Tp2(zero_alloc, 2, 1);
+  for (size_t i = 0; i < k; i++) {
+    Tp2(0, 0) += e(0, i) * p2(i, 0);
+    Tp2(1, 0) += r(0, i) * p2(i, 0);
+  }
+  Tp2.SwitchFormat();
+
+  Matrix<Field2n> center([]() { return Field2n(); }, 2, 1);
+  center(0, 0) = Field2n(Tp2(0, 0).CRTInterpolate())
+                     .ScalarMult(-c * c / (s * s - c * c));
+  center(1, 0) = Field2n(Tp2(1, 0).CRTInterpolate())
+                     .ScalarMult(-c * c / (s * s - c * c));
+
+  auto p1ZVector =
+      std::make_shared<Matrix<int64_t>>([]() { return 0; }, n * 2, 1);
+  LatticeGaussSampUtility<DCRTPoly>::ZSampleSigma2x2(
+      factors[0], factors[1], factors[2], center, dgg, p1ZVector);
+  Matrix<DCRTPoly> p1 = SplitInt64IntoElements<DCRTPoly>(*p1ZVector, n, params);
+  p1.SwitchFormat();
+
+  auto perturbation = std::make_shared<Matrix<DCRTPoly>>(std::move(p1));
+  perturbation->VStack(p2);
+  return perturbation;
+}
+
+std::pair<PublicKeySFDK<DCRTPoly>, KeyCipherGenKey<DCRTPoly>>
+lbcrypto::SFDKBFVRNS::GenReducedKeys(PublicKeySFDK<DCRTPoly> publicKey,
+                                     KeyCipherGenKey<DCRTPoly> keyGen,
+                                     uint towers) const {
+  const Matrix<DCRTPoly> &b = publicKey->GetLargePublicElements()[0];
+  const Matrix<DCRTPoly> &A = publicKey->GetLargePublicElements()[1];
+  const RLWETrapdoorPair<DCRTPoly> &trapdoor = *keyGen->GetPrivateElement();
+  const size_t total = A(0, 0).GetNumOfElements();
+  if (towers == 0 || towers > total) {
+    OPENFHE_THROW(config_error,
+                  "The reduced keys must keep between 1 and all the towers");
+  }
+  const auto cryptoParams =
+      std::static_pointer_cast<CryptoParametersBFVRNSSFDK>(
+          publicKey->GetCryptoParameters());
+  const size_t base = cryptoParams->GetBase();
+
+  auto reduce = [&](const DCRTPoly &element) {
+    DCRTPoly reduced = element;
+    reduced.DropLastElements(total - towers);
+    return reduced;
+  };
+
+  // The gadget over the first towers is a prefix of the full gadget, and
+  // every column of the key is still A z = u and b = -(e + A s) once read
+  // modulo the reduced modulus. The trapdoor entries are small, so dropping
+  // their towers keeps them unchanged.
+  const DCRTPoly one = reduce(A(0, 0));
+  double nBits =
+      floor(log2(one.GetParams()->GetModulus().ConvertToDouble() - 1.0) + 1.0);
+  // An approximate trapdoor keeps its dropped digits out of the prefix
+  const size_t droppedDigits = cryptoParams->GetApproxTrapdoorDigits();
+  const size_t digits = std::ceil(nBits / log2(base));
+  if (digits < droppedDigits + 2) {
+    OPENFHE_THROW(config_error,
+                  "The reduced modulus leaves less than two digits of the "
+                  "approximate trapdoor");
+  }
+  size_t k = digits - droppedDigits;
+  auto zero_alloc = DCRTPoly::Allocator(one.GetParams(), Format::EVALUATION);
+
+  Matrix<DCRTPoly> reducedA(zero_alloc, 1, k + 2);
+  Matrix<DCRTPoly> reducedB(zero_alloc, 1, k + 2);
+  for (size_t j = 0; j < k + 2; j++) {
+    reducedA(0, j) = reduce(A(0, j));
+    reducedB(0, j) = reduce(b(0, j));
+  }
+  Matrix<DCRTPoly> r(zero_alloc, 1, k);
+  Matrix<DCRTPoly> e(zero_alloc, 1, k);
+  for (size_t j = 0; j < k; j++) {
+    r(0, j) = reduce(trapdoor.m_r(0, j));
+    e(0, j) = reduce(trapdoor.m_e(0, j));
+  }
+
+  auto reducedKey = std::make_shared<PublicKeyImplSFDK<DCRTPoly>>(
+      publicKey->GetCryptoContext(), publicKey->GetKeyTag());
+  reducedKey->SetLargePublicElementAtIndex(0, std::move(reducedB));
+  reducedKey->SetLargePublicElementAtIndex(1, std::move(reducedA));
+
+  auto reducedGen = std::make_shared<KeyCipherGenKeyImpl<DCRTPoly>>(
+      keyGen->GetCryptoContext(), keyGen->GetKeyTag());
+  reducedGen->SetPrivateElement(
+      std::make_shared<RLWETrapdoorPair<DCRTPoly>>(r, e));
+  reducedGen->SetPerturbationFactors(PerturbationFactors(
+      *reducedGen->GetPrivateElement(), one.GetRingDimension(), base));
+
+  return {reducedKey, reducedGen};
+}
+
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::CompactResult(
+    ConstCiphertext<DCRTPoly> ciphertext, uint towers,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  const size_t current = ciphertext->GetElements()[0].GetNumOfElements();
+  if (towers == 0 || towers > current) {
+    OPENFHE_THROW(config_error,
+                  "A compact result keeps between 1 and all of its towers");
+  }
+  // Modulus switching to the first towers, which the keys of
+  // GenReducedKeys keep as well
+  return cryptoContext->Compress(ciphertext, towers);
+}
+
 KeyCipher<DCRTPoly> lbcrypto::SFDKBFVRNS::GenDecKeyFor(
     Ciphertext<DCRTPoly> &cipherText, KeyCipherGenKey<DCRTPoly> keyGen,
     PublicKeySFDK<DCRTPoly> publicKey) const {
@@ -105,34 +463,125 @@ KeyCipher<DCRTPoly> lbcrypto::SFDKBFVRNS::GenDecKeyFor(
           publicKey->GetCryptoParameters());
   auto params = cryptoParams->GetElementParams();
   size_t n = params->GetRingDimension();
-  size_t k = cryptoParams->GetK();
   size_t base = cryptoParams->GetBase();
 
-  EncodingParams ep(
-      std::make_shared<EncodingParamsImpl>(PlaintextModulus(512)));
-
-  DCRTPoly u = cipherTextElements[1];
-  u.SetFormat(Format::EVALUATION);
-
   // Getting the trapdoor, its public matrix, perturbation matrix and gaussian
-  // generator to use in sampling
-  auto A = publicKey->GetLargePublicElements()[1];
-  auto zero_alloc = DCRTPoly::Allocator(params, EVALUATION);
+  // generator to use in sampling. The width of the matrix is taken from the
+  // key itself, as reduced keys have fewer gadget columns.
+  const Matrix<DCRTPoly> &A = publicKey->GetLargePublicElements()[1];
+  size_t k = A.GetCols();
 
   DggType dgg = cryptoParams->GetDiscreteGaussianGenerator();
 
   DggType &dggLargeSigma =
       cryptoParams->GetDiscreteGaussianGeneratorLargeSigma();
 
-  Matrix<DCRTPoly> zHat = RLWETrapdoorUtility<DCRTPoly>::GaussSamp(
-      n, k - 2, A, *keyGen->GetPrivateElement(), u, dgg, dggLargeSigma, base);
+  Matrix<DCRTPoly> zHat = SampleDecKey(cipherTextElements[1], A, keyGen, dgg,
+                                       dggLargeSigma, n, k, base);
 
   return std::make_shared<KeyCipherImpl<DCRTPoly>>(
-      std::make_shared<Matrix<DCRTPoly>>(zHat), publicKey);
+      std::make_shared<Matrix<DCRTPoly>>(std::move(zHat)), publicKey);
+}
+
+std::vector<KeyCipher<DCRTPoly>> lbcrypto::SFDKBFVRNS::GenDecKeysFor(
+    std::vector<Ciphertext<DCRTPoly>> &cipherTexts,
+    KeyCipherGenKey<DCRTPoly> keyGen,
+    PublicKeySFDK<DCRTPoly> publicKey) const {
+  for (const auto &cipherText : cipherTexts) {
+    if (cipherText == nullptr) {
+      OPENFHE_THROW(config_error, "Input ciphertext is nullptr");
+    }
+    if (cipherText->GetElements().size() != 2) {
+      OPENFHE_THROW(config_error,
+                    "Specific DecKey is only defined for ciphertexts of size 2"
+                    "Please relinearize before");
+    }
+  }
+
+  // Setup shared by every key of the batch
+  const auto cryptoParams =
+      std::static_pointer_cast<CryptoParametersBFVRNSSFDK>(
+          publicKey->GetCryptoParameters());
+  auto params = cryptoParams->GetElementParams();
+  size_t n = params->GetRingDimension();
+  size_t base = cryptoParams->GetBase();
+  const Matrix<DCRTPoly> &A = publicKey->GetLargePublicElements()[1];
+  size_t k = A.GetCols();
+
+  std::vector<KeyCipher<DCRTPoly>> keys(cipherTexts.size());
+
+  // Keys for independent ciphertexts are sampled in parallel, each thread
+  // with its own copy of the gaussian generators
+#pragma omp parallel
+  {
+    DggType dgg = cryptoParams->GetDiscreteGaussianGenerator();
+    DggType dggLargeSigma =
+        cryptoParams->GetDiscreteGaussianGeneratorLargeSigma();
+#pragma omp for schedule(dynamic)
+    for (size_t i = 0; i < cipherTexts.size(); i++) {
+      Matrix<DCRTPoly> zHat =
+          SampleDecKey(cipherTexts[i]->GetElements()[1], A, keyGen, dgg,
+                       dggLargeSigma, n, k, base);
+      keys[i] = std::make_shared<KeyCipherImpl<DCRTPoly>>(
+          std::make_shared<Matrix<DCRTPoly>>(std::move(zHat)), publicKey);
+    }
+  }
+
+  return keys;
+}
+
+void lbcrypto::SFDKBFVRNS::StartPerturbationPool(
+    KeyCipherGenKey<DCRTPoly> keyGen, size_t capacity,
+    usint numThreads) const {
+  const auto cryptoParams =
+      std::static_pointer_cast<CryptoParametersBFVRNSSFDK>(
+          keyGen->GetCryptoParameters());
+  size_t n = cryptoParams->GetElementParams()->GetRingDimension();
+  size_t base = cryptoParams->GetBase();
+  auto trapdoor = keyGen->GetPrivateElement();
+  // The workers share the covariance terms, computed here if the key has none
+  auto factors = std::make_shared<const std::vector<Field2n>>(
+      keyGen->GetPerturbationFactors().empty()
+          ? PerturbationFactors(*trapdoor, n, base)
+          : keyGen->GetPerturbationFactors());
+
+  // Each worker samples with its own copy of the generators
+  auto sampler = [cryptoParams, trapdoor, factors, n, base]() {
+    DggType dgg = cryptoParams->GetDiscreteGaussianGenerator();
+    DggType dggLargeSigma =
+        cryptoParams->GetDiscreteGaussianGeneratorLargeSigma();
+    return SamplePerturbation(*trapdoor, *factors, dgg, dggLargeSigma, n,
+                              base);
+  };
+
+  auto pool = keyGen->GetPerturbationPool();
+  if (pool != nullptr) {
+    pool->Stop();
+  }
+  pool = std::make_shared<PerturbationPool<DCRTPoly>>(sampler, capacity,
+                                                      numThreads);
+  keyGen->SetPerturbationPool(pool);
+  pool->Start();
+}
+
+void lbcrypto::SFDKBFVRNS::StopPerturbationPool(
+    KeyCipherGenKey<DCRTPoly> keyGen) const {
+  auto pool = keyGen->GetPerturbationPool();
+  if (pool != nullptr) {
+    pool->Stop();
+  }
 }
 
 Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::Encrypt(
     DCRTPoly plaintext, const PublicKeySFDK<DCRTPoly> publicKey) const {
+  std::vector<DCRTPoly> plaintexts;
+  plaintexts.push_back(std::move(plaintext));
+  return EncryptBatch(std::move(plaintexts), publicKey)[0];
+}
+
+std::vector<Ciphertext<DCRTPoly>> lbcrypto::SFDKBFVRNS::EncryptBatch(
+    std::vector<DCRTPoly> plaintexts,
+    const PublicKeySFDK<DCRTPoly> publicKey) const {
   //----------------------------------------------------------------------------------
   // Test parameters
   //----------------------------------------------------------------------------------
@@ -148,314 +597,825 @@ Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::Encrypt(
   }
   auto elementParams = cryptoParams->GetElementParams();
   size_t sizeQ = elementParams->GetParams().size();
-  auto encParams = plaintext.GetParams();
-  size_t sizeP = encParams->GetParams().size();
-
-  if (sizeP != sizeQ) {
-    OPENFHE_THROW(config_error,
-                  "Not Supported: Plaintext encodings with smaller number of "
-                  "RNS limbs than the public key");
+  for (const auto &plaintext : plaintexts) {
+    if (plaintext.GetParams()->GetParams().size() != sizeQ) {
+      OPENFHE_THROW(config_error,
+                    "Not Supported: Plaintext encodings with smaller number of "
+                    "RNS limbs than the public key");
+    }
   }
 
   //----------------------------------------------------------------------------------
-  // Multiply Plaintext
+  // Constants shared by the whole batch
   //----------------------------------------------------------------------------------
-  std::vector<NativeInteger> tInvModq = cryptoParams->GettInvModq();
+  const std::vector<NativeInteger> &tInvModq = cryptoParams->GettInvModq();
   const NativeInteger t = cryptoParams->GetPlaintextModulus();
-  NativeInteger NegQModt = cryptoParams->GetNegQModt(0);
-  NativeInteger NegQModtPrecon = cryptoParams->GetNegQModtPrecon(0);
-
-  plaintext.SetFormat(Format::COEFFICIENT);
-  plaintext.TimesQovert(encParams, tInvModq, t, NegQModt, NegQModtPrecon);
-  plaintext.SetFormat(Format::EVALUATION);
-
-  //----------------------------------------------------------------------------------
-  // Generates Zero Encrytion and add scaled plaintext
-  //----------------------------------------------------------------------------------
+  const NativeInteger NegQModt = cryptoParams->GetNegQModt(0);
+  const NativeInteger NegQModtPrecon = cryptoParams->GetNegQModtPrecon(0);
 
   const DggType &dgg = cryptoParams->GetDiscreteGaussianGenerator();
 
-  Matrix<DCRTPoly> p0 = publicKey->GetLargePublicElements().at(0);
-  Matrix<DCRTPoly> p1 = publicKey->GetLargePublicElements().at(1);
+  // The public key is kept in EVALUATION format since KeyGen, so it is read
+  // in place; only keys stored in another format are converted on a copy
+  const Matrix<DCRTPoly> &pk0 = publicKey->GetLargePublicElements().at(0);
+  const Matrix<DCRTPoly> &pk1 = publicKey->GetLargePublicElements().at(1);
+  std::unique_ptr<Matrix<DCRTPoly>> p0Eval, p1Eval;
+  if (pk0(0, 0).GetFormat() != Format::EVALUATION) {
+    p0Eval = std::make_unique<Matrix<DCRTPoly>>(pk0);
+    p0Eval->SetFormat(Format::EVALUATION);
+  }
+  if (pk1(0, 0).GetFormat() != Format::EVALUATION) {
+    p1Eval = std::make_unique<Matrix<DCRTPoly>>(pk1);
+    p1Eval->SetFormat(Format::EVALUATION);
+  }
+  const Matrix<DCRTPoly> &p0 = p0Eval ? *p0Eval : pk0;
+  const Matrix<DCRTPoly> &p1 = p1Eval ? *p1Eval : pk1;
 
   auto zero_alloc = DCRTPoly::Allocator(elementParams, EVALUATION);
   auto gaussian_alloc = DCRTPoly::MakeDiscreteGaussianCoefficientAllocator(
       elementParams, Format::COEFFICIENT, dgg.GetStd());
 
-  Matrix<DCRTPoly> u(zero_alloc, p0.GetData()[0].size(), 1, gaussian_alloc);
-
-  DCRTPoly e1(dgg, elementParams, Format::EVALUATION);
-  DCRTPoly e2(dgg, elementParams, Format::EVALUATION);  // new version
+  const auto ns = cryptoParams->GetNoiseScale();
 
-  DCRTPoly c0(elementParams);
-  DCRTPoly c1(elementParams);
+  // A seeded context samples item i from fork i of the stream of this call
+  std::unique_ptr<PRNGStreamSFDK> stream = NextPRNGStream(*cryptoParams);
 
-  p0.SetFormat(Format::EVALUATION);
-  p1.SetFormat(Format::EVALUATION);
-  u.SetFormat(Format::EVALUATION);
+  std::vector<Ciphertext<DCRTPoly>> ciphertexts(plaintexts.size());
 
-  const auto ns = cryptoParams->GetNoiseScale();
+  // Items are independent; a single item keeps the inner kernels parallel
+#pragma omp parallel for schedule(dynamic) if (plaintexts.size() > 1)
+  for (size_t i = 0; i < plaintexts.size(); i++) {
+    //----------------------------------------------------------------------------------
+    // Multiply Plaintext
+    //----------------------------------------------------------------------------------
+    DCRTPoly &plaintext = plaintexts[i];
+    plaintext.SetFormat(Format::COEFFICIENT);
+    plaintext.TimesQovert(plaintext.GetParams(), tInvModq, t, NegQModt,
+                          NegQModtPrecon);
+    plaintext.SetFormat(Format::EVALUATION);
 
-  c0 = SdfkUtils::dotProd(p0, u) + ns * e1 + plaintext;
+    //----------------------------------------------------------------------------------
+    // Generates Zero Encrytion and add scaled plaintext
+    //----------------------------------------------------------------------------------
+    Matrix<DCRTPoly> u(zero_alloc, p0.GetCols(), 1);
+    DCRTPoly e1, e2;
+    if (stream != nullptr) {
+      PRNGStreamSFDK itemStream = stream->Fork(i);
+      for (size_t j = 0; j < u.GetRows(); j++) {
+        u(j, 0) =
+            itemStream.Gaussian(elementParams, dgg.GetStd(), Format::EVALUATION);
+      }
+      e1 = itemStream.Gaussian(elementParams, dgg.GetStd(), Format::EVALUATION);
+      e2 = itemStream.Gaussian(elementParams, dgg.GetStd(), Format::EVALUATION);
+    } else {
+      u = Matrix<DCRTPoly>(zero_alloc, p0.GetCols(), 1, gaussian_alloc);
+      e1 = DCRTPoly(dgg, elementParams, Format::EVALUATION);
+      e2 = DCRTPoly(dgg, elementParams, Format::EVALUATION);  // new version
+      u.SetFormat(Format::EVALUATION);
+    }
 
-  c1 = SdfkUtils::dotProd(p1, u) + ns * e2;
+    // c0 and c1 share u, so both inner products are taken in one sweep
+    auto pu = SdfkUtils::fusedDotProd(p0, p1, u);
 
-  //----------------------------------------------------------------------------------
-  // Build Ciphertext
-  //----------------------------------------------------------------------------------
-  Ciphertext<DCRTPoly> ciphertext(
-      std::make_shared<CiphertextImpl<DCRTPoly>>(publicKey));
-  ciphertext->SetElements({std::move(c0), std::move(c1)});
-  ciphertext->SetNoiseScaleDeg(1);
+    DCRTPoly c0 = std::move(pu.first);
+    c0 += ns * e1;
+    c0 += plaintext;
 
-  return ciphertext;
-}
+    DCRTPoly c1 = std::move(pu.second);
+    c1 += ns * e2;
 
-DecryptResult ScaleAndRound(
-    DCRTPoly &b, NativePoly *plaintext,
-    std::shared_ptr<CryptoParametersBFVRNSSFDK> cryptoParams) {
-  b.SetFormat(Format::COEFFICIENT);
-  if (cryptoParams->GetMultiplicationTechnique() == HPS ||
-      cryptoParams->GetMultiplicationTechnique() == HPSPOVERQ ||
-      cryptoParams->GetMultiplicationTechnique() == HPSPOVERQLEVELED) {
-    *plaintext = b.ScaleAndRound(cryptoParams->GetPlaintextModulus(),
-                                 cryptoParams->GettQHatInvModqDivqModt(),
-                                 cryptoParams->GettQHatInvModqDivqModtPrecon(),
-                                 cryptoParams->GettQHatInvModqBDivqModt(),
-                                 cryptoParams->GettQHatInvModqBDivqModtPrecon(),
-                                 cryptoParams->GettQHatInvModqDivqFrac(),
-                                 cryptoParams->GettQHatInvModqBDivqFrac());
-  } else {
-    *plaintext = b.ScaleAndRound(
-        cryptoParams->GetModuliQ(), cryptoParams->GetPlaintextModulus(),
-        cryptoParams->Gettgamma(), cryptoParams->GettgammaQHatInvModq(),
-        cryptoParams->GettgammaQHatInvModqPrecon(),
-        cryptoParams->GetNegInvqModtgamma(),
-        cryptoParams->GetNegInvqModtgammaPrecon());
+    //----------------------------------------------------------------------------------
+    // Build Ciphertext
+    //----------------------------------------------------------------------------------
+    Ciphertext<DCRTPoly> ciphertext(
+        std::make_shared<CiphertextImpl<DCRTPoly>>(publicKey));
+    ciphertext->SetElements({std::move(c0), std::move(c1)});
+    ciphertext->SetNoiseScaleDeg(1);
+    ciphertexts[i] = std::move(ciphertext);
   }
 
-  return DecryptResult(plaintext->GetLength());
+  return ciphertexts;
 }
 
 DecryptResult lbcrypto::SFDKBFVRNS::Decrypt(const Ciphertext<DCRTPoly> &ciphertext,
                                             const KeyCipher<DCRTPoly> &decKey,
                                             const PublicKeySFDK<DCRTPoly> publicKey,
                                             Plaintext *plaintext) {
-  const std::vector<Matrix<DCRTPoly>> &pubKeyElements =
-      publicKey->GetLargePublicElements();
-  Matrix<DCRTPoly> b = pubKeyElements[0];
+  return SFDKDecryptor(publicKey).Decrypt(ciphertext, decKey, plaintext);
+}
 
-  const std::vector<DCRTPoly> &c = ciphertext->GetElements();
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::ReplicateQuery(
+    Ciphertext<DCRTPoly> ciphertext, uint count,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  if (count == 0) {
+    OPENFHE_THROW(config_error, "Cannot replicate a query into zero slots");
+  }
+  const uint half = cryptoContext->GetRingDimension() / 2;
+  const uint m = cryptoContext->GetCyclotomicOrder();
+
+  // Baby steps: the rotations by -1..-(PSM_BABY_STEPS-1) are all taken from
+  // the same ciphertext, so they share a single key-switch digit
+  // decomposition. babies[j] holds j+1 copies of the query.
+  const uint nbabies = std::min(count, PSM_BABY_STEPS);
+  std::vector<Ciphertext<DCRTPoly>> babies(nbabies);
+  babies[0] = ciphertext;
+  if (nbabies > 1) {
+    auto digits = cryptoContext->EvalFastRotationPrecompute(ciphertext);
+    for (uint j = 1; j < nbabies; j++) {
+      // a rotation by -j is a rotation by half-j inside each slot row
+      babies[j] = cryptoContext->EvalAdd(
+          babies[j - 1],
+          cryptoContext->EvalFastRotation(ciphertext, half - j, m, digits));
+    }
+  }
 
-  DCRTPoly r = c[0];
-  r.SetFormat(Format::EVALUATION);
-  b.SetFormat(Format::EVALUATION);
-  decKey->getPrivateElement()->SetFormat(Format::EVALUATION);
-  auto zHat = *decKey->getPrivateElement();
-  auto bt = SdfkUtils::dotProd(b, zHat);
-  r -= bt;
+  // Giant steps: blocks of PSM_BABY_STEPS copies are doubled and the blocks
+  // selected by the bits of count/PSM_BABY_STEPS are placed one after the
+  // other, so exactly count slots hold the query
+  const uint r = count % PSM_BABY_STEPS;
+  const uint q = count / PSM_BABY_STEPS;
+  Ciphertext<DCRTPoly> result = r != 0 ? babies[r - 1] : nullptr;
+  if (q == 0) {
+    return result;
+  }
+  Ciphertext<DCRTPoly> block = babies[PSM_BABY_STEPS - 1];
+  for (uint bit = 1, width = PSM_BABY_STEPS; bit <= q;
+       bit <<= 1, width <<= 1) {
+    if (bit > 1) {
+      block = cryptoContext->EvalAdd(
+          block, cryptoContext->EvalAtIndex(block, -int32_t(width / 2)));
+    }
+    if ((q & bit) != 0) {
+      result = result == nullptr
+                   ? block
+                   : cryptoContext->EvalAdd(
+                         block, cryptoContext->EvalAtIndex(result,
+                                                           -int32_t(width)));
+    }
+  }
+  return result;
+}
+
+PowerCircuit lbcrypto::SFDKBFVRNS::PlanPowerCircuit(uint64_t exponent) {
+  if (exponent == 0) {
+    OPENFHE_THROW(config_error, "The power circuit exponent must be positive");
+  }
+  PowerCircuit circuit;
+  while ((exponent >> (circuit.squarings + 1)) != 0) {
+    circuit.squarings++;
+  }
+
+  // Every set bit is a node of the squaring chain at the depth of its
+  // position. Multiplying the two shallowest nodes first keeps the output at
+  // depth ceil(log2(exponent)), with one product per extra set bit.
+  using Node = std::pair<uint32_t, size_t>;  // (depth, node)
+  std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+  for (uint32_t i = 0; i <= circuit.squarings; i++) {
+    if (((exponent >> i) & 1) != 0) {
+      heap.push({i, i});
+    }
+  }
+  size_t next = circuit.squarings + 1;
+  while (heap.size() > 1) {
+    Node a = heap.top();
+    heap.pop();
+    Node b = heap.top();
+    heap.pop();
+    circuit.products.emplace_back(a.second, b.second);
+    heap.push({std::max(a.first, b.first) + 1, next++});
+  }
+  circuit.output = heap.top().second;
+  circuit.depth = heap.top().first;
+  return circuit;
+}
 
-  // this is the resulting vector of coefficients;
+uint32_t lbcrypto::SFDKBFVRNS::GetPSMDepth(PlaintextModulus plaintextModulus,
+                                          uint32_t chunks, bool replicated) {
+  uint32_t treeDepth = 0;
+  while ((uint64_t(1) << treeDepth) < chunks) {
+    treeDepth++;
+  }
+  // The replicated query is masked to the set size before the power
+  const uint32_t masks = replicated ? 2 : 1;
+  return PlanPowerCircuit(plaintextModulus - 1).depth + treeDepth + masks;
+}
 
-  auto vp = std::make_shared<typename NativePoly::Params>(
-      ciphertext->GetElements()[0].GetParams()->GetCyclotomicOrder(),
-      decKey->GetCryptoContext()->GetEncodingParams()->GetPlaintextModulus(),
-      1);
-  Plaintext decrypted = PlaintextFactory::MakePlaintext(
-      ciphertext->GetEncodingType(), vp,
-      decKey->GetCryptoContext()->GetEncodingParams());
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::EvalPower(
+    Ciphertext<DCRTPoly> ciphertext, const PowerCircuit &circuit,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  // Products are relinearized as they are made: the result is rotated
+  // afterwards, which needs two component ciphertexts
+  std::vector<Ciphertext<DCRTPoly>> nodes;
+  nodes.reserve(circuit.squarings + 1 + circuit.products.size());
+  nodes.push_back(ciphertext);
+  for (uint32_t i = 0; i < circuit.squarings; i++) {
+    nodes.push_back(cryptoContext->EvalSquare(nodes.back()));
+  }
+  for (const auto &product : circuit.products) {
+    nodes.push_back(
+        cryptoContext->EvalMult(nodes[product.first], nodes[product.second]));
+  }
+  return nodes[circuit.output];
+}
 
-  DecryptResult result =
-      ScaleAndRound(r, &decrypted->GetElement<NativePoly>(),
-                    std::static_pointer_cast<CryptoParametersBFVRNSSFDK>(
-                        decKey->GetCryptoParameters()));
-  decrypted->Decode();
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::SumNonZero(
+    Ciphertext<DCRTPoly> ciphertext, uint count,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  // Caclulate the x^(p-1) mod p, where x is each of the slot values.
+  // The slot with a zero value remains zero, all the other became 1 by the
+  // Fermat Little Theorem
+  auto p = cryptoContext->GetCryptoParameters()->GetPlaintextModulus();
+  Ciphertext<DCRTPoly> result =
+      EvalPower(ciphertext, PlanPowerCircuit(p - 1), cryptoContext);
 
-  if (result.isValid == false) return result;
+  // Add every element in the vector, by adding half of the vetor slots with the
+  // other half for ceil(log(size)) times. The window is the smallest power of
+  // two holding count slots, so it never crosses into the next block.
+  uint rot = 1;
+  while (rot < count) {
+    rot <<= 1;
+  }
+  for (rot = rot / 2; rot > 0; rot = rot / 2) {
+    result =
+        cryptoContext->EvalAdd(result, cryptoContext->EvalAtIndex(result, rot));
+  }
+  return result;
+}
 
-  *plaintext = std::move(decrypted);
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::CountNonZero(
+    Ciphertext<DCRTPoly> ciphertext, uint count,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext, uint blockWidth) const {
+  Ciphertext<DCRTPoly> result = SumNonZero(ciphertext, count, cryptoContext);
+
+  // Use a mask to clean all other slot elements besides the first of each
+  // block, and subtracts the size of the vector from them
+  auto masks = cryptoContext->GetPlaintextCache()->Get(
+      PlaintextCache::MakeKey("count", {count, blockWidth}), [&]() {
+        const uint n = cryptoContext->GetRingDimension();
+        const uint blocks = blockWidth == 0 ? 1 : n / blockWidth;
+        const uint stride = blockWidth == 0 ? 1 : blockWidth;
+        std::vector<int64_t> mask_2((blocks - 1) * stride + 1, 0);
+        std::vector<int64_t> _size_v(mask_2.size(), 0);
+        for (uint i = 0; i < blocks; i++) {
+          mask_2[i * stride] = 1;
+          _size_v[i * stride] = int64_t(count) - 1;
+        }
+        Plaintext mask2 = cryptoContext->MakePackedPlaintext(mask_2);
+        mask2->SetFormat(Format::EVALUATION);
+        return PlaintextCache::Entry{
+            mask2, cryptoContext->MakePackedPlaintext(_size_v)};
+      });
+  result = cryptoContext->EvalMult(result, masks[0]);
+  result = cryptoContext->EvalSub(result, masks[1]);
 
+  // Returns 0 if ciphertext is in the set or 1 if it is not
   return result;
 }
 
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::PrivateSetMembershipPacked(
+    Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &_testset,
+    uint blockWidth, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  Ciphertext<DCRTPoly> result =
+      ComparePacked(ciphertext, _testset, blockWidth, cryptoContext);
+
+  return CountNonZero(result, _testset.size(), cryptoContext, blockWidth);
+}
+
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::ComparePacked(
+    Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &_testset,
+    uint blockWidth, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  const uint n = cryptoContext->GetRingDimension();
+  const uint size = _testset.size();
+  if (blockWidth == 0 || (blockWidth & (blockWidth - 1)) != 0 ||
+      (n / 2) % blockWidth != 0) {
+    OPENFHE_THROW(config_error,
+                  "Block width must be a power of two dividing half the ring "
+                  "dimension");
+  }
+  if (size == 0 || size > blockWidth) {
+    OPENFHE_THROW(config_error,
+                  "Set size must be between 1 and the block width");
+  }
+
+  // Every block is compared against its own copy of the set
+  std::vector<int64_t> key(1, blockWidth);
+  key.insert(key.end(), _testset.begin(), _testset.end());
+  Plaintext testset = cryptoContext->GetPlaintextCache()->Get(
+      PlaintextCache::MakeKey("packed", key), [&]() {
+        std::vector<int64_t> layout(n, 0);
+        for (uint block = 0; block < n; block += blockWidth) {
+          std::copy(_testset.begin(), _testset.end(), layout.begin() + block);
+        }
+        return PlaintextCache::Entry{cryptoContext->MakePackedPlaintext(layout)};
+      })[0];
+
+  // The rotations move every block by the same amount, and the copies never
+  // pass the end of their block, so all the queries are replicated at once
+  cryptoContext->EnsureRotationKeys(PlanPSMRotations(size));
+  Ciphertext<DCRTPoly> result = ReplicateQuery(ciphertext, size, cryptoContext);
+  return cryptoContext->EvalSub(result, testset);
+}
+
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::PrivateSetIntersectionCardinality(
+    Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &_testset,
+    uint blockWidth, uint queries,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  const uint half = cryptoContext->GetRingDimension() / 2;
+  if (blockWidth == 0 || queries == 0 || queries > half / blockWidth) {
+    OPENFHE_THROW(config_error,
+                  "Number of queries must be between 1 and the blocks of half "
+                  "the ring dimension");
+  }
+  // A repeated element would count a query twice
+  std::vector<int64_t> elements(_testset);
+  std::sort(elements.begin(), elements.end());
+  elements.erase(std::unique(elements.begin(), elements.end()), elements.end());
+  const uint size = elements.size();
+
+  // Block i holds size minus 1 if query i matches, and size otherwise
+  Ciphertext<DCRTPoly> result =
+      ComparePacked(ciphertext, elements, blockWidth, cryptoContext);
+  result = SumNonZero(result, size, cryptoContext);
+
+  // Add the blocks of the slot row in slot 0
+  cryptoContext->EnsureRotationKeys(
+      PlanCardinalityRotations(size, blockWidth, half * 2));
+  for (uint rot = blockWidth; rot < half; rot <<= 1) {
+    result =
+        cryptoContext->EvalAdd(result, cryptoContext->EvalAtIndex(result, rot));
+  }
+
+  // The blocks without a query compare 0, whose matches the server knows:
+  // the count is blocks*size - (blocks-queries)*[0 in set] - sum
+  const uint blocks = half / blockWidth;
+  const bool zero = std::binary_search(elements.begin(), elements.end(), 0);
+  auto masks = cryptoContext->GetPlaintextCache()->Get(
+      PlaintextCache::MakeKey("cardinality",
+                              {size, blockWidth, queries, zero ? 1 : 0}),
+      [&]() {
+        // The count is encoded in the centered range of the plaintext
+        // modulus, which may be smaller than the number of slots
+        const int64_t t = cryptoContext->GetCryptoParameters()
+                              ->GetPlaintextModulus();
+        int64_t count = (int64_t(blocks) * size -
+                         (zero ? int64_t(blocks - queries) : 0)) % t;
+        if (count > t / 2) {
+          count -= t;
+        }
+        std::vector<int64_t> first = {1};
+        std::vector<int64_t> total = {count};
+        Plaintext mask = cryptoContext->MakePackedPlaintext(first);
+        mask->SetFormat(Format::EVALUATION);
+        return PlaintextCache::Entry{mask,
+                                     cryptoContext->MakePackedPlaintext(total)};
+      });
+  result = cryptoContext->EvalMult(result, masks[0]);
+
+  // Returns the number of queries in the set in slot 0
+  return cryptoContext->EvalAdd(cryptoContext->EvalNegate(result), masks[1]);
+}
+
+
 Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::PrivateSetMembership(
     Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &_testset,
     CryptoContextImplSFDK<DCRTPoly> *cryptoContext)  {
-  Plaintext testset = cryptoContext->MakePackedPlaintext(_testset);
-  uint size = _testset.size();
+  if (_testset.empty()) {
+    OPENFHE_THROW(config_error, "The test set is empty");
+  }
+  auto chunks = cryptoContext->GetPlaintextCache()->Get(
+      PlaintextCache::MakeKey("set", _testset), [&]() {
+        // Repeated elements would zero more than one slot, and the count
+        // would no longer be 0 or 1
+        std::vector<int64_t> elements(_testset);
+        std::sort(elements.begin(), elements.end());
+        elements.erase(std::unique(elements.begin(), elements.end()),
+                       elements.end());
+
+        // Split the set in chunks of one slot row
+        const uint chunkSize = cryptoContext->GetRingDimension() / 2;
+        std::vector<std::vector<int64_t>> values;
+        for (size_t i = 0; i < elements.size(); i += chunkSize) {
+          values.emplace_back(elements.begin() + i,
+                              elements.begin() +
+                                  std::min(elements.size(), i + chunkSize));
+        }
+        return EncodeChunks(values, cryptoContext);
+      });
+
   // Copy ciphertext to every slot to be compared
-  // The number of rot/add is ceil(log(size)) where size is the number of
-  // elements in the Private Set
-  uint rot, prot = 1;
+  uint size = chunks[0]->GetLength();
+  cryptoContext->EnsureRotationKeys(PlanPSMRotations(size));
+  Ciphertext<DCRTPoly> result = ReplicateQuery(ciphertext, size, cryptoContext);
 
-  Ciphertext<DCRTPoly> result = nullptr;
-  if ((size & 1) != 0) {
-      result =  ciphertext;
-  }
-  for (rot = 2; rot <= size; rot = rot << 1) {
-    ciphertext = cryptoContext->EvalAdd(
-        ciphertext, cryptoContext->EvalAtIndex(ciphertext, -prot));
-    if ((size & rot) != 0) {
-      result = result == nullptr
-                   ? ciphertext
-                   : cryptoContext->EvalAdd(
-                         ciphertext, cryptoContext->EvalAtIndex(result, -rot));
-    }
-    prot = rot;
+  ciphertext = MultiplyChunkDifferences(result, chunks, cryptoContext);
 
+  return CountNonZero(ciphertext, size, cryptoContext);
+}
+
+std::vector<Plaintext> lbcrypto::SFDKBFVRNS::EncodeChunks(
+    const std::vector<std::vector<int64_t>> &chunks,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  // A short chunk is padded with the first chunk, so its extra slots repeat
+  // a difference already in the product
+  std::vector<Plaintext> plaintexts(chunks.size());
+#pragma omp parallel for if (chunks.size() > 1)
+  for (size_t i = 0; i < chunks.size(); i++) {
+    std::vector<int64_t> values(chunks[0]);
+    std::copy(chunks[i].begin(), chunks[i].end(), values.begin());
+    plaintexts[i] = cryptoContext->MakePackedPlaintext(values);
   }
+  return plaintexts;
+}
 
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::MultiplyChunkDifferences(
+    Ciphertext<DCRTPoly> ciphertext, const std::vector<Plaintext> &chunks,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
   // Subtract every element in the private set from one of the copies of the
   // plaintext. The slot with an equal value becames zero, all the others are
   // different from zero.
-  ciphertext = cryptoContext->EvalSub(result, testset);
+  std::vector<Ciphertext<DCRTPoly>> level(chunks.size());
+#pragma omp parallel for if (chunks.size() > 1)
+  for (size_t i = 0; i < chunks.size(); i++) {
+    level[i] = cryptoContext->EvalSub(ciphertext, chunks[i]);
+  }
 
-  // Caclulate the x^(p-1) mod p, where x is each of the slot values.
-  // The slot with a zero value remains zero, all the other became 1 by the
-  // Fermat Little Theorem
-  auto p = cryptoContext->GetCryptoParameters()->GetPlaintextModulus();
+  // Balanced product tree: a slot is zero if any chunk zeroed it, and the
+  // depth grows with the log of the number of chunks
+  while (level.size() > 1) {
+    std::vector<Ciphertext<DCRTPoly>> next((level.size() + 1) / 2);
+#pragma omp parallel for if (level.size() > 3)
+    for (size_t i = 0; i < level.size() / 2; i++) {
+      next[i] = cryptoContext->EvalMult(level[2 * i], level[2 * i + 1]);
+    }
+    if (level.size() % 2 != 0) {
+      next.back() = level.back();
+    }
+    level = std::move(next);
+  }
+  return level[0];
+}
 
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::PrivateSetMembershipReplicated(
+    Ciphertext<DCRTPoly> ciphertext, const std::vector<int64_t> &_testset,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  uint size = _testset.size();
+  if (size == 0 || size > cryptoContext->GetRingDimension() / 2) {
+    OPENFHE_THROW(config_error,
+                  "Set size must be between 1 and half the ring dimension");
+  }
+  auto plaintexts = cryptoContext->GetPlaintextCache()->Get(
+      PlaintextCache::MakeKey("replicated", _testset), [&]() {
+        std::vector<int64_t> ones(size, 1);
+        Plaintext mask = cryptoContext->MakePackedPlaintext(ones);
+        mask->SetFormat(Format::EVALUATION);
+        return PlaintextCache::Entry{
+            cryptoContext->MakePackedPlaintext(_testset), mask};
+      });
+
+  // The query already fills the slots, only the first size copies are kept
+  cryptoContext->EnsureRotationKeys(PlanPSMRotations(size, false));
+  ciphertext = cryptoContext->EvalMult(ciphertext, plaintexts[1]);
+  ciphertext = cryptoContext->EvalSub(ciphertext, plaintexts[0]);
+
+  return CountNonZero(ciphertext, size, cryptoContext);
+}
 
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::PrivateSetMembership(
+    Ciphertext<DCRTPoly> ciphertext, uint start, uint size,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext)  {
+  if (size == 0) {
+    OPENFHE_THROW(config_error, "The interval is empty");
+  }
+  const uint chunkSize = cryptoContext->GetRingDimension() / 2;
+  uint comp_size = size > chunkSize ? chunkSize : size;
 
-  ciphertext = cryptoContext->EvalMult(ciphertext, ciphertext);
+  // Copy ciphertext to every slot to be compared
+  cryptoContext->EnsureRotationKeys(PlanPSMRotations(comp_size));
+  Ciphertext<DCRTPoly> filled_ciphertext =
+      ReplicateQuery(ciphertext, comp_size, cryptoContext);
+
+  auto chunks = cryptoContext->GetPlaintextCache()->Get(
+      PlaintextCache::MakeKey("range", {start, size}), [&]() {
+        std::vector<std::vector<int64_t>> values;
+        for (uint t = 0; t < size; t += chunkSize) {
+          std::vector<int64_t> plainvector(std::min(chunkSize, size - t));
+          std::iota(std::begin(plainvector), std::end(plainvector),
+                    int64_t(start) + t);
+          values.push_back(std::move(plainvector));
+        }
+        return EncodeChunks(values, cryptoContext);
+      });
+  ciphertext = MultiplyChunkDifferences(filled_ciphertext, chunks,
+                                        cryptoContext);
+
+  return CountNonZero(ciphertext, comp_size, cryptoContext);
+}
 
-  result = (p & 2) != 0 ? ciphertext : nullptr;
+void lbcrypto::SFDKBFVRNS::PreparePSM(
+    PrivateKey<DCRTPoly> secretKey, uint maxsize,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext)  {
+  // Larger sets are split in chunks of one slot row
+  auto half = cryptoContext->GetRingDimension() / 2;
+  if (maxsize > half) {
+    maxsize = half;
+  }
+  // Every set size up to maxsize must be supported, so the keys are the
+  // union of the plans of all of them
+  std::set<int32_t> keys4shifts;
+  for (uint size = 1; size <= maxsize; size++) {
+    auto plan = PlanPSMRotations(size);
+    keys4shifts.insert(plan.begin(), plan.end());
+  }
+  if (!keys4shifts.empty()) {
+    cryptoContext->EvalAtIndexKeyGen(
+        secretKey,
+        std::vector<int32_t>(keys4shifts.begin(), keys4shifts.end()));
+  }
+}
 
-  for (uint mask = 4; mask < p; mask <<= 1) {
-    ciphertext = cryptoContext->EvalMult(ciphertext, ciphertext);
-    if ((p & mask) != 0) {
-      if (result == nullptr) {
-        result = ciphertext;
-      } else {
-        result = cryptoContext->EvalMult(result, ciphertext);
+std::vector<int32_t> lbcrypto::SFDKBFVRNS::PlanPSMRotations(uint count,
+                                                            bool replicate) {
+  std::set<int32_t> indices;
+  if (replicate) {
+    // Same walk as ReplicateQuery: baby steps, block doublings, and the
+    // shifts placing a block after the copies already made
+    for (uint j = 1; j < std::min(count, PSM_BABY_STEPS); j++) {
+      indices.insert(-int32_t(j));
+    }
+    const uint q = count / PSM_BABY_STEPS;
+    bool placed = count % PSM_BABY_STEPS != 0;
+    for (uint bit = 1, width = PSM_BABY_STEPS; bit <= q;
+         bit <<= 1, width <<= 1) {
+      if (bit > 1) {
+        indices.insert(-int32_t(width / 2));
+      }
+      if ((q & bit) != 0) {
+        if (placed) {
+          indices.insert(-int32_t(width));
+        }
+        placed = true;
       }
     }
-    
   }
+  // Window sum of CountNonZero
+  uint rot = 1;
+  while (rot < count) {
+    rot <<= 1;
+  }
+  for (rot = rot / 2; rot > 0; rot = rot / 2) {
+    indices.insert(int32_t(rot));
+  }
+  return std::vector<int32_t>(indices.begin(), indices.end());
+}
 
-  // Creates a mask to clean the extra values in the vector, beyond the size of
-  // the set Multiplies the mask by the ciphertext
-  // std::vector<int64_t> mask_1(size, 1);
-  // Plaintext mask1 = cryptoContext->MakePackedPlaintext(mask_1);
-  // result = cryptoContext->EvalMult(result,mask1);
+std::vector<int32_t> lbcrypto::SFDKBFVRNS::PlanCardinalityRotations(
+    uint count, uint blockWidth, uint ringDimension) {
+  std::vector<int32_t> indices = PlanPSMRotations(count);
+  for (uint rot = blockWidth; rot < ringDimension / 2; rot <<= 1) {
+    indices.push_back(int32_t(rot));
+  }
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+  return indices;
+}
 
-  // Add every element in the vector, by adding half of the vetor slots with the
-  // other half for ceil(log(size)) times
-  for (rot = rot / 2; rot > 0; rot = rot / 2) {
-    result =
-        cryptoContext->EvalAdd(result, cryptoContext->EvalAtIndex(result, rot));
+std::vector<int32_t> lbcrypto::SFDKBFVRNS::PlanAggregateRotations(
+    uint count) {
+  std::vector<int32_t> indices;
+  for (uint rot = 1; rot < count; rot <<= 1) {
+    indices.push_back(-int32_t(rot));
   }
+  std::sort(indices.begin(), indices.end());
+  return indices;
+}
 
-  // Use a mask to clean all other slot elements besides the first
-  std::vector<int64_t> mask_2(1, 1);
-  Plaintext mask2 = cryptoContext->MakePackedPlaintext(mask_2);
-  result = cryptoContext->EvalMult(result, mask2);
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::AggregateResults(
+    const std::vector<Ciphertext<DCRTPoly>> &results, bool mask,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
+  const uint count = results.size();
+  if (count == 0 || count > cryptoContext->GetRingDimension() / 2) {
+    OPENFHE_THROW(config_error,
+                  "Number of results must be between 1 and half the ring "
+                  "dimension");
+  }
+  cryptoContext->EnsureRotationKeys(PlanAggregateRotations(count));
+
+  // Results whose other slots are not known to be zero keep only slot 0
+  std::vector<Ciphertext<DCRTPoly>> level(results);
+  if (mask) {
+    Plaintext first = cryptoContext->GetPlaintextCache()->Get(
+        PlaintextCache::MakeKey("first", {}), [&]() {
+          std::vector<int64_t> values = {1};
+          Plaintext plaintext = cryptoContext->MakePackedPlaintext(values);
+          plaintext->SetFormat(Format::EVALUATION);
+          return PlaintextCache::Entry{plaintext};
+        })[0];
+#pragma omp parallel for if (count > 1)
+    for (uint i = 0; i < count; i++) {
+      level[i] = cryptoContext->EvalMult(level[i], first);
+    }
+  }
 
-  // Subtracts the size of the vector
-  Plaintext _size = cryptoContext->MakePackedPlaintext({size - 1});
-  result = cryptoContext->EvalSub(result, _size);
+  // Merge tree: at step j every ciphertext holds 2^j results in its first
+  // slots, and the right one of each pair is shifted after the left one, so
+  // result i ends in slot i with only log2(count) distinct rotations
+  for (uint rot = 1; level.size() > 1; rot <<= 1) {
+    std::vector<Ciphertext<DCRTPoly>> next((level.size() + 1) / 2);
+#pragma omp parallel for if (level.size() > 3)
+    for (size_t i = 0; i < level.size() / 2; i++) {
+      next[i] = cryptoContext->EvalAdd(
+          level[2 * i],
+          cryptoContext->EvalAtIndex(level[2 * i + 1], -int32_t(rot)));
+    }
+    if (level.size() % 2 != 0) {
+      next.back() = level.back();
+    }
+    level = std::move(next);
+  }
+  return level[0];
+}
 
-  // Returns 0 if ciphertext is in the set or 1 if it is not
-  return result;
+void lbcrypto::SFDKBFVRNS::PrepareAggregation(
+    PrivateKey<DCRTPoly> secretKey, uint count,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) {
+  auto indices = PlanAggregateRotations(count);
+  if (!indices.empty()) {
+    cryptoContext->EvalAtIndexKeyGen(secretKey, indices);
+  }
 }
 
-Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::PrivateSetMembership(
-    Ciphertext<DCRTPoly> ciphertext, uint start, uint size,
-    CryptoContextImplSFDK<DCRTPoly> *cryptoContext)  {
-  auto n = cryptoContext->GetRingDimension();
-  uint comp_size = size > n ? n : size;
+std::vector<int32_t> lbcrypto::SFDKBFVRNS::PlanRangeRotations(uint copies,
+                                                              uint width) {
+  std::set<int32_t> indices;
+  // Replication of the digits and sum of the blocks
+  for (uint rot = width; rot < copies * width; rot <<= 1) {
+    indices.insert(-int32_t(rot));
+    indices.insert(int32_t(rot));
+  }
+  // Product of the slots of a block
+  for (uint rot = 1; rot < width; rot <<= 1) {
+    indices.insert(int32_t(rot));
+  }
+  return std::vector<int32_t>(indices.begin(), indices.end());
+}
 
-  // Copy ciphertext to every slot to be compared
-  // The number of rot/add is ceil(log(size)) where size is the number of
-  // elements in the Private Set
-  uint rot, prot = 1;
+uint lbcrypto::SFDKBFVRNS::GetRangeBlockWidth(uint digits) {
+  uint width = 1;
+  while (width < digits) {
+    width <<= 1;
+  }
+  return width;
+}
 
+uint lbcrypto::SFDKBFVRNS::GetRangeSlots(uint base, uint digits) {
+  // At most base-1 blocks on each side of every level, plus the whole domain
+  return (2 * (base - 1) * digits + 1) * GetRangeBlockWidth(digits);
+}
 
-  Ciphertext<DCRTPoly> filled_ciphertext = (comp_size & 1) != 0 ? ciphertext : nullptr;
-  for (rot = 2; rot <= comp_size; rot = rot << 1) {
-    ciphertext = cryptoContext->EvalAdd(
-        ciphertext, cryptoContext->EvalAtIndex(ciphertext, -prot));
-    if ((comp_size & rot) != 0) {
-      filled_ciphertext = filled_ciphertext == nullptr
-                              ? ciphertext
-                              : cryptoContext->EvalAdd(
-                                    ciphertext, cryptoContext->EvalAtIndex(
-                                                    filled_ciphertext, -rot));
-    }
-    prot = rot;
+uint32_t lbcrypto::SFDKBFVRNS::GetRangeDepth(PlaintextModulus plaintextModulus,
+                                            uint digits) {
+  uint32_t blockDepth = 0;
+  while ((1u << blockDepth) < GetRangeBlockWidth(digits)) {
+    blockDepth++;
   }
+  return PlanPowerCircuit(plaintextModulus - 1).depth + blockDepth + 2;
+}
 
-  for (uint t = 0; t <= size / n; t++) {
-    std::vector<int64_t> plainvector(
-        t == (size / n) ? size - t * n : n);  // vector with 100 ints.
-    std::iota(std::begin(plainvector), std::end(plainvector),
-              start + t * n);  // Fill with 0, 1, ..., 99.
-    Plaintext testset = cryptoContext->MakePackedPlaintext(plainvector);
-    // Subtract every element in the set from one of the copies of the
-    // plaintext. The slot with an equal value becames zero, all the others are
-    // different from zero.
-    ciphertext = t == 0 ? cryptoContext->EvalSub(filled_ciphertext, testset)
-                        : cryptoContext->EvalMult(
-                              ciphertext, cryptoContext->EvalSub(
-                                              filled_ciphertext, testset));
+std::vector<std::pair<uint64_t, uint>> lbcrypto::SFDKBFVRNS::DecomposeRange(
+    uint64_t start, uint64_t size, uint base, uint digits) {
+  // Cover [start, start+size) with aligned blocks: a block (prefix, level)
+  // holds the values whose digits from level up are those of prefix. Each
+  // level trims at most base-1 blocks from each end of the interval.
+  std::vector<std::pair<uint64_t, uint>> blocks;
+  uint64_t lo = start;
+  uint64_t hi = start + size;
+  uint64_t step = 1;
+  for (uint level = 0; lo < hi && level <= digits; level++, step *= base) {
+    const uint64_t next = step * base;
+    while (lo < hi && (level == digits || lo % next != 0)) {
+      blocks.emplace_back(lo, level);
+      lo += step;
+    }
+    while (lo < hi && hi % next != 0) {
+      hi -= step;
+      blocks.emplace_back(hi, level);
+    }
   }
+  return blocks;
+}
 
-  // Caclulate the x^(p-1) mod p, where x is each of the slot values.
-  // The slot with a zero value remains zero, all the other became 1 by the
-  // Fermat Little Theorem
+Ciphertext<DCRTPoly> lbcrypto::SFDKBFVRNS::PrivateRangeMembership(
+    Ciphertext<DCRTPoly> ciphertext, uint64_t start, uint64_t size, uint base,
+    uint digits, CryptoContextImplSFDK<DCRTPoly> *cryptoContext) const {
   auto p = cryptoContext->GetCryptoParameters()->GetPlaintextModulus();
-
-  ciphertext = cryptoContext->EvalMult(ciphertext, ciphertext);
-
-  Ciphertext<DCRTPoly> result = ((p & 2) != 0) ?ciphertext : nullptr;
-  
-  for (uint mask = 4; mask < p; mask <<= 1) {
-    ciphertext = cryptoContext->EvalMult(ciphertext, ciphertext);
-    if ((p & mask) != 0) {
-      result = result == nullptr ? ciphertext
-                                 : cryptoContext->EvalMult(result, ciphertext);
+  if (base < 2 || base >= p) {
+    OPENFHE_THROW(config_error,
+                  "Digit base must be between 2 and the plaintext modulus");
+  }
+  uint64_t domain = 1;
+  for (uint j = 0; j < digits; j++) {
+    if (domain > std::numeric_limits<uint64_t>::max() / base) {
+      OPENFHE_THROW(config_error, "Too many digits for 64 bit values");
     }
-    
+    domain *= base;
+  }
+  if (size == 0 || start > domain || size > domain - start) {
+    OPENFHE_THROW(config_error,
+                  "The interval must be non empty and fit in the digits");
+  }
+  const uint width = GetRangeBlockWidth(digits);
+  if (GetRangeSlots(base, digits) > cryptoContext->GetRingDimension() / 2) {
+    OPENFHE_THROW(config_error,
+                  "Too many digit blocks for half the ring dimension");
   }
 
-  // Add every element in the vector, by adding half of the vetor slots with the
-  // other half for ceil(log(size)) times
-  for (rot = rot / 2; rot > 0; rot = rot / 2) {
-    result =
-        cryptoContext->EvalAdd(result, cryptoContext->EvalAtIndex(result, rot));
+  const auto blocks = DecomposeRange(start, size, base, digits);
+  uint copies = 1;
+  while (copies < blocks.size()) {
+    copies <<= 1;
   }
 
-  // Use a mask to clean all other slot elements besides the first
-  std::vector<int64_t> mask_2(1, 1);
-  Plaintext mask2 = cryptoContext->MakePackedPlaintext(mask_2);
-  result = cryptoContext->EvalMult(result, mask2);
+  // Copy the digits of the query, in the first width slots, to every block
+  cryptoContext->EnsureRotationKeys(PlanRangeRotations(copies, width));
+  for (uint rot = width; rot < copies * width; rot <<= 1) {
+    ciphertext = cryptoContext->EvalAdd(
+        ciphertext, cryptoContext->EvalAtIndex(ciphertext, -int32_t(rot)));
+  }
 
-  // Subtracts the size of the vector
-  Plaintext _size =
-      cryptoContext->MakePackedPlaintext({size > n ? n - 1 : size - 1});
-  result = cryptoContext->EvalSub(result, _size);
+  // Block k holds the digits of its prefix, and only the digits from its
+  // level up are compared. The copies with no block compare their first
+  // digit against base, which no digit equals.
+  auto plaintexts = cryptoContext->GetPlaintextCache()->Get(
+      PlaintextCache::MakeKey("digits", {int64_t(start), int64_t(size), base,
+                                         digits}),
+      [&]() {
+        std::vector<int64_t> prefixes(copies * width, 0);
+        std::vector<int64_t> care(copies * width, 0);
+        for (uint k = 0; k < copies; k++) {
+          if (k >= blocks.size()) {
+            prefixes[k * width] = base;
+            care[k * width] = 1;
+            continue;
+          }
+          uint64_t prefix = blocks[k].first;
+          for (uint j = 0; j < digits; j++, prefix /= base) {
+            prefixes[k * width + j] = int64_t(prefix % base);
+            care[k * width + j] = j >= blocks[k].second ? 1 : 0;
+          }
+        }
+        std::vector<int64_t> ones(copies * width, 1);
+        std::vector<int64_t> first = {1};
+        PlaintextCache::Entry entry{
+            cryptoContext->MakePackedPlaintext(prefixes),
+            cryptoContext->MakePackedPlaintext(care),
+            cryptoContext->MakePackedPlaintext(ones),
+            cryptoContext->MakePackedPlaintext(first),
+            cryptoContext->MakePackedPlaintext(first)};
+        entry[1]->SetFormat(Format::EVALUATION);
+        entry[3]->SetFormat(Format::EVALUATION);
+        return entry;
+      });
+  ciphertext = cryptoContext->EvalSub(ciphertext, plaintexts[0]);
+
+  // Fermat: 1 for a differing digit, 0 for an equal one. The digits below
+  // the level of a block are ignored, and every slot is turned into 1 for a
+  // match and 0 otherwise.
+  auto p_1 = EvalPower(ciphertext, PlanPowerCircuit(p - 1), cryptoContext);
+  ciphertext = cryptoContext->EvalAdd(
+      cryptoContext->EvalNegate(cryptoContext->EvalMult(p_1, plaintexts[1])),
+      plaintexts[2]);
+
+  // The product of the slots of a block is 1 if the query is in the block
+  for (uint rot = 1; rot < width; rot <<= 1) {
+    ciphertext = cryptoContext->EvalMult(
+        ciphertext, cryptoContext->EvalAtIndex(ciphertext, rot));
+  }
 
-  // Returns 0 if ciphertext is in the set or 1 if it is not
-  return result;
+  // The blocks are disjoint, so at most one of them matches
+  for (uint rot = width; rot < copies * width; rot <<= 1) {
+    ciphertext = cryptoContext->EvalAdd(
+        ciphertext, cryptoContext->EvalAtIndex(ciphertext, rot));
+  }
+
+  // Returns 0 if the query is in the interval or 1 if it is not
+  ciphertext = cryptoContext->EvalMult(ciphertext, plaintexts[3]);
+  return cryptoContext->EvalAdd(cryptoContext->EvalNegate(ciphertext),
+                                plaintexts[4]);
 }
 
-void lbcrypto::SFDKBFVRNS::PreparePSM(
-    PrivateKey<DCRTPoly> secretKey, uint maxsize,
-    CryptoContextImplSFDK<DCRTPoly> *cryptoContext)  {
-  auto n = cryptoContext->GetRingDimension();
-  if (maxsize > n) {
-    maxsize = n;
+void lbcrypto::SFDKBFVRNS::PrepareRangeMembership(
+    PrivateKey<DCRTPoly> secretKey, uint base, uint digits,
+    CryptoContextImplSFDK<DCRTPoly> *cryptoContext) {
+  // Keys for the largest number of blocks an interval can need
+  const uint width = GetRangeBlockWidth(digits);
+  uint copies = 1;
+  while (copies * width < GetRangeSlots(base, digits)) {
+    copies <<= 1;
   }
-  std::vector<int32_t> keys4shifts = {};
-  uint i;
-
-  for (i = 1; i < maxsize; i <<= 1) {
-    keys4shifts.push_back(i);
-    keys4shifts.push_back(-i);
+  auto indices = PlanRangeRotations(copies, width);
+  if (!indices.empty()) {
+    cryptoContext->EvalAtIndexKeyGen(secretKey, indices);
   }
-  keys4shifts.push_back(i);
-  keys4shifts.push_back(-i);
-  cryptoContext->EvalAtIndexKeyGen(secretKey, keys4shifts);
 }
 
 DCRTPoly DivideApproxBySQRootOfNorm(const DCRTPoly e, usint &bits) {
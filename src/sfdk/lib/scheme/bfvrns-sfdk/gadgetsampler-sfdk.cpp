@@ -0,0 +1,262 @@
+//==================================================================================
+// Author Carlos Ribeiro
+//
+//==================================================================================
+
+#include "scheme/bfvrns-sfdk/gadgetsampler-sfdk.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @namespace lbcrypto
+ * The namespace of lbcrypto
+ */
+namespace lbcrypto {
+
+// The products of the digit reconstruction are below 2^48, so a few thousand
+// of them add up in a limb without overflow
+static constexpr uint32_t MAX_LOG_BASE = 24;
+
+bool GadgetSamplerSFDK::Supports(uint64_t base, size_t k) {
+  return base >= 2 && (base & (base - 1)) == 0 &&
+         base <= (uint64_t(1) << MAX_LOG_BASE) && k >= 2;
+}
+
+GadgetSamplerSFDK::GadgetSamplerSFDK(const std::shared_ptr<ParmType> &params,
+                                     uint64_t base, size_t k)
+    : m_base(base), m_logBase(0), m_k(k) {
+  if (!Supports(base, k)) {
+    OPENFHE_THROW(config_error,
+                  "The RNS gadget sampler needs a power of two base of at "
+                  "most 2^24 and two digits or more");
+  }
+  while ((uint64_t(1) << m_logBase) < base) {
+    m_logBase++;
+  }
+  m_chunks = (64 + m_logBase - 1) / m_logBase;
+  m_limbs = k + m_chunks + 1;
+
+  const BigInteger &q = params->GetModulus();
+  if (q.GetMSB() > k * m_logBase) {
+    OPENFHE_THROW(config_error,
+                  "The gadget digits do not cover the modulus of the towers");
+  }
+
+  // Base-b digits of a multiprecision integer, only used to build the tables
+  const BigInteger bigBase(base);
+  auto digits = [&](BigInteger x) {
+    std::vector<int64_t> result(m_limbs, 0);
+    for (size_t t = 0; t < m_limbs; t++) {
+      result[t] = x.Mod(bigBase).ConvertToInt<int64_t>();
+      x >>= m_logBase;
+    }
+    return result;
+  };
+
+  const size_t towers = params->GetParams().size();
+  m_moduli.resize(towers);
+  m_qHatInvModq.resize(towers);
+  m_qHatInvModqPrecon.resize(towers);
+  m_qHatDigits.resize(towers);
+  m_qInv.resize(towers);
+  for (size_t i = 0; i < towers; i++) {
+    const NativeInteger &qi = params->GetParams()[i]->GetModulus();
+    const BigInteger qHat = q / BigInteger(qi.ConvertToInt<uint64_t>());
+    NativeInteger qHatModqi(
+        qHat.Mod(BigInteger(qi.ConvertToInt<uint64_t>())).ConvertToInt<uint64_t>());
+    m_moduli[i] = qi;
+    m_qHatInvModq[i] = qHatModqi.ModInverse(qi);
+    m_qHatInvModqPrecon[i] = m_qHatInvModq[i].PrepModMulConst(qi);
+    m_qHatDigits[i] = digits(qHat);
+    m_qInv[i] = 1.0 / qi.ConvertToDouble();
+  }
+  m_qDigits = digits(q);
+
+  // Sampling tables of LatticeGaussSampUtility::GaussSampGqArbBase, for the
+  // width used by RLWETrapdoorUtility::GaussSamp
+  const double b = static_cast<double>(base);
+  const double c = (b + 1) * SIGMA;
+  m_sigma = c / (b + 1);
+
+  m_l.resize(k);
+  m_h.resize(k + 1);
+  m_d.resize(k);
+  m_l[0] = std::sqrt(b * (1 + 1.0 / k) + 1);
+  for (size_t i = 1; i < k; i++) {
+    m_l[i] = std::sqrt(b * (1 + 1.0 / (k - i)));
+  }
+  m_h[0] = 0;
+  for (size_t i = 1; i < k; i++) {
+    m_h[i] = std::sqrt(b * (1 - 1.0 / (k - i + 1)));
+  }
+  m_h[k] = 0;
+  m_d[0] = m_qDigits[0] / b;
+  for (size_t i = 1; i < k; i++) {
+    m_d[i] = (m_d[i - 1] + m_qDigits[i]) / b;
+  }
+}
+
+void GadgetSamplerSFDK::Digits(const DCRTPoly &u, size_t j,
+                               std::vector<int64_t> &acc,
+                               int64_t *digits) const {
+  const int64_t base = static_cast<int64_t>(m_base);
+  const int64_t mask = base - 1;
+
+  // u = sum_i y_i q/q_i - v q, with y_i = [u_i (q/q_i)^-1]_{q_i} and
+  // v = floor(sum_i y_i/q_i), accumulated on base-b limbs
+  std::fill(acc.begin(), acc.end(), 0);
+  double fraction = 0;
+  for (size_t i = 0; i < m_moduli.size(); i++) {
+    uint64_t y = u.GetElementAtIndex(i)[j]
+                     .ModMulFastConst(m_qHatInvModq[i], m_moduli[i],
+                                      m_qHatInvModqPrecon[i])
+                     .ConvertToInt<uint64_t>();
+    fraction += static_cast<double>(y) * m_qInv[i];
+    const std::vector<int64_t> &qHat = m_qHatDigits[i];
+    for (size_t a = 0; a < m_chunks && y != 0; a++, y >>= m_logBase) {
+      const int64_t chunk = static_cast<int64_t>(y) & mask;
+      for (size_t t = 0; t + a < m_limbs; t++) {
+        acc[t + a] += chunk * qHat[t];
+      }
+    }
+  }
+  const int64_t v = static_cast<int64_t>(std::floor(fraction));
+  for (size_t t = 0; t < m_limbs; t++) {
+    acc[t] -= v * m_qDigits[t];
+  }
+
+  // Brings the limbs to [0, b), leaving the sign in the top one
+  auto normalize = [&]() {
+    for (size_t t = 0; t + 1 < m_limbs; t++) {
+      const int64_t low = acc[t] & mask;
+      acc[t + 1] += (acc[t] - low) / base;
+      acc[t] = low;
+    }
+  };
+  auto atLeastQ = [&]() {
+    for (size_t t = m_limbs; t-- > 0;) {
+      if (acc[t] != m_qDigits[t]) {
+        return acc[t] > m_qDigits[t];
+      }
+    }
+    return true;
+  };
+
+  // The floating point quotient can be off by one when u is close to 0 or q
+  normalize();
+  while (acc[m_limbs - 1] < 0) {
+    for (size_t t = 0; t < m_limbs; t++) {
+      acc[t] += m_qDigits[t];
+    }
+    normalize();
+  }
+  while (atLeastQ()) {
+    for (size_t t = 0; t < m_limbs; t++) {
+      acc[t] -= m_qDigits[t];
+    }
+    normalize();
+  }
+  std::copy(acc.begin(), acc.begin() + m_k, digits);
+}
+
+void GadgetSamplerSFDK::SampleGq(const DCRTPoly &u, DggType &dgg,
+                                 Matrix<int64_t> *z) const {
+  if (u.GetFormat() != Format::COEFFICIENT) {
+    OPENFHE_THROW(config_error,
+                  "The gadget sampler needs the syndrome in COEFFICIENT "
+                  "format");
+  }
+  if (u.GetNumOfElements() != m_moduli.size()) {
+    OPENFHE_THROW(config_error,
+                  "The syndrome and the gadget sampler have different "
+                  "numbers of towers");
+  }
+
+  const size_t k = m_k;
+  const int64_t b = static_cast<int64_t>(m_base);
+  std::vector<int64_t> acc(m_limbs);
+  std::vector<int64_t> v(k);
+  std::vector<int64_t> perturb(k);
+  std::vector<int64_t> p(k);
+  std::vector<int64_t> zj(k);
+  std::vector<double> a(k);
+
+  for (size_t j = 0; j < u.GetRingDimension(); j++) {
+    Digits(u, j, acc, v.data());
+
+    // Perturbation making the distribution of the output spherical
+    double beta = 0;
+    for (size_t i = 0; i < k; i++) {
+      perturb[i] = dgg.GenerateIntegerKarney(beta / m_l[i], m_sigma / m_l[i]);
+      beta = -perturb[i] * m_h[i + 1];
+    }
+    p[0] = (2 * b + 1) * perturb[0] + b * perturb[1];
+    for (size_t i = 1; i + 1 < k; i++) {
+      p[i] = b * (perturb[i - 1] + 2 * perturb[i] + perturb[i + 1]);
+    }
+    p[k - 1] = b * (perturb[k - 2] + 2 * perturb[k - 1]);
+
+    a[0] = static_cast<double>(v[0] - p[0]) / b;
+    for (size_t t = 1; t < k; t++) {
+      a[t] = (a[t - 1] + static_cast<double>(v[t] - p[t])) / b;
+    }
+
+    // SampleC on the lattice of the modulus digits
+    zj[k - 1] =
+        dgg.GenerateIntegerKarney(-a[k - 1] / m_d[k - 1], m_sigma / m_d[k - 1]);
+    for (size_t i = 0; i + 1 < k; i++) {
+      zj[i] = dgg.GenerateIntegerKarney(-(a[i] + zj[k - 1] * m_d[i]), m_sigma);
+    }
+
+    (*z)(0, j) = b * zj[0] + m_qDigits[0] * zj[k - 1] + v[0];
+    for (size_t t = 1; t + 1 < k; t++) {
+      (*z)(t, j) = b * zj[t] - zj[t - 1] + m_qDigits[t] * zj[k - 1] + v[t];
+    }
+    (*z)(k - 1, j) = m_qDigits[k - 1] * zj[k - 1] - zj[k - 2] + v[k - 1];
+  }
+}
+
+Matrix<DCRTPoly> GadgetSamplerSFDK::GaussSampOnline(
+    const Matrix<DCRTPoly> &A, const RLWETrapdoorPair<DCRTPoly> &T,
+    const DCRTPoly &u, DggType &dgg,
+    const std::shared_ptr<Matrix<DCRTPoly>> &perturbation) const {
+  const std::shared_ptr<ParmType> params = u.GetParams();
+  const size_t n = u.GetRingDimension();
+  const Matrix<DCRTPoly> &pHat = *perturbation;
+  // An approximate trapdoor keeps the last digits of the gadget only
+  const size_t kept = A.GetCols() - 2;
+  if (kept > m_k) {
+    OPENFHE_THROW(config_error,
+                  "The public matrix has more gadget digits than the sampler");
+  }
+  const size_t dropped = m_k - kept;
+
+  DCRTPoly perturbedSyndrome = u - (A.Mult(pHat))(0, 0);
+  perturbedSyndrome.SetFormat(Format::COEFFICIENT);
+
+  Matrix<int64_t> zHatBBI([]() { return 0; }, m_k, n);
+  SampleGq(perturbedSyndrome, dgg, &zHatBBI);
+
+  Matrix<DCRTPoly> zHat = SplitInt64AltIntoElements<DCRTPoly>(zHatBBI, n, params);
+  zHat.SwitchFormat();
+
+  // [e z, r z, z] + p is a preimage of u for A = [1, a, g - (a r + e)].
+  // With the low digits of g dropped, A maps it to u minus the low digits
+  // of z, which only adds a small error.
+  Matrix<DCRTPoly> zHigh(DCRTPoly::Allocator(params, Format::EVALUATION), kept,
+                         1);
+  for (size_t row = 0; row < kept; row++) {
+    zHigh(row, 0) = std::move(zHat(row + dropped, 0));
+  }
+  Matrix<DCRTPoly> zHatPrime(DCRTPoly::Allocator(params, Format::EVALUATION),
+                             kept + 2, 1);
+  zHatPrime(0, 0) = pHat(0, 0) + (T.m_e.Mult(zHigh))(0, 0);
+  zHatPrime(1, 0) = pHat(1, 0) + (T.m_r.Mult(zHigh))(0, 0);
+  for (size_t row = 2; row < kept + 2; row++) {
+    zHatPrime(row, 0) = pHat(row, 0) + zHigh(row - 2, 0);
+  }
+  return zHatPrime;
+}
+
+}  // namespace lbcrypto
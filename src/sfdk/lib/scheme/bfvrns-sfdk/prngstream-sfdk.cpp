@@ -0,0 +1,120 @@
+//==================================================================================
+// Author Carlos Ribeiro
+//
+//==================================================================================
+
+#include "scheme/bfvrns-sfdk/prngstream-sfdk.h"
+#include "utils_sfdk.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @namespace lbcrypto
+ * The namespace of lbcrypto
+ */
+namespace lbcrypto {
+
+// Domains of the Blake2 seeds, so a stream and its forks never share the
+// words of their seeds
+static constexpr uint32_t STREAM_DOMAIN = 1;
+static constexpr uint32_t FORK_DOMAIN   = 2;
+
+PRNGStreamSFDK::PRNGStreamSFDK(const Seed &seed) : m_seed(seed) {
+  std::array<uint32_t, 16> streamSeed{};
+  std::copy(seed.begin(), seed.end(), streamSeed.begin());
+  streamSeed[15] = STREAM_DOMAIN;
+  m_engine = std::make_unique<default_prng::Blake2Engine>(streamSeed);
+}
+
+PRNGStreamSFDK::PRNGStreamSFDK(uint64_t seed)
+    : PRNGStreamSFDK(Seed{static_cast<uint32_t>(seed),
+                          static_cast<uint32_t>(seed >> 32)}) {}
+
+PRNGStreamSFDK PRNGStreamSFDK::Fork(uint64_t index) const {
+  std::array<uint32_t, 16> forkSeed{};
+  std::copy(m_seed.begin(), m_seed.end(), forkSeed.begin());
+  forkSeed[8] = static_cast<uint32_t>(index);
+  forkSeed[9] = static_cast<uint32_t>(index >> 32);
+  forkSeed[15] = FORK_DOMAIN;
+  default_prng::Blake2Engine prng(forkSeed);
+
+  Seed seed;
+  for (auto &w : seed) {
+    w = static_cast<uint32_t>(prng());
+  }
+  return PRNGStreamSFDK(seed);
+}
+
+PRNGStreamSFDK::Seed PRNGStreamSFDK::NextSeed() {
+  Seed seed;
+  for (auto &w : seed) {
+    w = static_cast<uint32_t>((*m_engine)());
+  }
+  return seed;
+}
+
+uint64_t PRNGStreamSFDK::NextWord() {
+  const uint64_t hi = (*m_engine)();
+  const uint64_t lo = (*m_engine)();
+  return (hi << 32) | (lo & 0xffffffff);
+}
+
+double PRNGStreamSFDK::NextDouble() {
+  return static_cast<double>(NextWord() >> 11) * 0x1.0p-53;
+}
+
+int64_t PRNGStreamSFDK::GaussianInteger(double mean, double stddev) {
+  const int64_t low = static_cast<int64_t>(std::floor(mean - TAIL * stddev));
+  const uint64_t width =
+      static_cast<uint64_t>(std::ceil(mean + TAIL * stddev) - low) + 1;
+  const double scale = -1.0 / (2 * stddev * stddev);
+  while (true) {
+    const int64_t x = low + static_cast<int64_t>(NextWord() % width);
+    const double d = static_cast<double>(x) - mean;
+    if (NextDouble() < std::exp(d * d * scale)) {
+      return x;
+    }
+  }
+}
+
+DCRTPoly PRNGStreamSFDK::Gaussian(const std::shared_ptr<ParmType> &params,
+                                  double stddev, Format format) {
+  std::vector<int64_t> values(params->GetRingDimension());
+  for (auto &v : values) {
+    v = GaussianInteger(0, stddev);
+  }
+  return FromIntegers(values, params, format);
+}
+
+DCRTPoly PRNGStreamSFDK::Ternary(const std::shared_ptr<ParmType> &params,
+                                 Format format) {
+  std::vector<int64_t> values(params->GetRingDimension());
+  for (auto &v : values) {
+    v = static_cast<int64_t>(NextWord() % 3) - 1;
+  }
+  return FromIntegers(values, params, format);
+}
+
+DCRTPoly PRNGStreamSFDK::Uniform(const std::shared_ptr<ParmType> &params) {
+  return SdfkUtils::expandUniform(NextSeed(), params);
+}
+
+DCRTPoly PRNGStreamSFDK::FromIntegers(const std::vector<int64_t> &values,
+                                      const std::shared_ptr<ParmType> &params,
+                                      Format format) {
+  DCRTPoly result(params, Format::COEFFICIENT, true);
+  auto &towers = result.GetAllElements();
+  for (auto &tower : towers) {
+    const uint64_t q = tower.GetModulus().ConvertToInt<uint64_t>();
+    for (size_t c = 0; c < values.size(); c++) {
+      const int64_t v = values[c];
+      tower[c] = NativeInteger(v < 0 ? q - static_cast<uint64_t>(-v)
+                                     : static_cast<uint64_t>(v));
+    }
+  }
+  result.SetFormat(format);
+  return result;
+}
+
+}  // namespace lbcrypto
@@ -0,0 +1,440 @@
+// @file
+// @author Carlos Ribeiro
+//
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "cryptocontext-sfdk.h"
+#include "scheme/bfvrns-sfdk/bfvrns-ser-sfdk.h"
+#include "scheme/bfvrns-sfdk/gadgetsampler-sfdk.h"
+#include "utils_sfdk.h"
+
+#include "encoding/encodings.h"
+
+#include "utils/debug.h"
+
+using namespace std;
+using namespace lbcrypto;
+
+class UTBFVrnsOTK : public ::testing::Test {
+ protected:
+  void SetUp() {}
+
+  void TearDown() {
+    CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+  }
+
+ public:
+};
+
+static CryptoContextSFDK<DCRTPoly> GenerateOTKContext(
+    bool seeded = false, uint32_t approxTrapdoorDigits = 0,
+    uint64_t prngSeed = 0) {
+  CCParams<CryptoContextBFVRNSSFDK> parameters;
+  parameters.SetPlaintextModulus(65537);
+  parameters.SetMultiplicativeDepth(1);
+  parameters.SetBase(4194304);
+  parameters.SetSeededPublicKey(seeded);
+  parameters.SetApproxTrapdoorDigits(approxTrapdoorDigits);
+  parameters.SetPRNGSeed(prngSeed);
+
+  CryptoContextSFDK<DCRTPoly> cc = GenCryptoContext(parameters);
+  cc->Enable(PKE);
+  cc->Enable(KEYSWITCH);
+  cc->Enable(LEVELEDSHE);
+  cc->Enable(SFDK);
+  return cc;
+}
+
+// Serializes an object and loads it back, as a key sent over the wire
+template <typename T>
+static T SerialRoundTrip(const T &obj) {
+  std::stringstream stream;
+  Serial::Serialize(obj, stream, SerType::BINARY);
+  T loaded;
+  Serial::Deserialize(loaded, stream, SerType::BINARY);
+  return loaded;
+}
+
+TEST_F(UTBFVrnsOTK, OTK_Decrypt) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+
+  std::vector<int64_t> vectorOfInts = {1, 0, 3, 1, 0, 1, 2, 1};
+  Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+  Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(kp.publicKey, plaintext);
+
+  auto cipherKey = cc->GenDecKeyFor(ciphertext, kp.cipherKeyGen, kp.publicKey);
+  Plaintext result;
+  cc->DecryptSFDK(ciphertext, cipherKey, kp.publicKey, &result);
+  result->SetLength(vectorOfInts.size());
+
+  EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+      << "OTK decryption fails";
+}
+
+TEST_F(UTBFVrnsOTK, OTK_Decrypt_PerturbationPool) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+
+  cc->StartPerturbationPool(kp.cipherKeyGen, 2);
+  auto pool = kp.cipherKeyGen->GetPerturbationPool();
+  pool->Fill();
+  // Without workers the pool is not refilled behind the key generation
+  pool->Stop();
+  const size_t pooled = pool->Size();
+  ASSERT_EQ(pooled, 2u);
+
+  std::vector<int64_t> vectorOfInts = {2, 1, 3, 2, 2, 1, 3, 1};
+  Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+  Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(kp.publicKey, plaintext);
+
+  auto cipherKey = cc->GenDecKeyFor(ciphertext, kp.cipherKeyGen, kp.publicKey);
+  EXPECT_EQ(pool->Size(), pooled - 1)
+      << "GenDecKeyFor did not consume a pooled perturbation";
+  cc->StopPerturbationPool(kp.cipherKeyGen);
+
+  Plaintext result;
+  cc->DecryptSFDK(ciphertext, cipherKey, kp.publicKey, &result);
+  result->SetLength(vectorOfInts.size());
+
+  EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+      << "OTK decryption with precomputed perturbation fails";
+}
+
+TEST_F(UTBFVrnsOTK, OTK_Decrypt_PerturbationFactors) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  EXPECT_EQ(kp.cipherKeyGen->GetPerturbationFactors().size(), 3u)
+      << "Key generation does not precompute the perturbation factors";
+
+  std::vector<int64_t> vectorOfInts = {1, 4, 1, 4, 2, 1, 3, 5};
+  Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+  Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(kp.publicKey, plaintext);
+
+  // Keys generated with and without the precomputed factors
+  for (bool precomputed : {true, false}) {
+    if (!precomputed) {
+      kp.cipherKeyGen->SetPerturbationFactors({});
+    }
+    auto cipherKey =
+        cc->GenDecKeyFor(ciphertext, kp.cipherKeyGen, kp.publicKey);
+    Plaintext result;
+    cc->DecryptSFDK(ciphertext, cipherKey, kp.publicKey, &result);
+    result->SetLength(vectorOfInts.size());
+    EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+        << "OTK decryption fails with precomputed factors " << precomputed;
+  }
+}
+
+TEST_F(UTBFVrnsOTK, OTK_Decrypt_Batch) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+
+  std::vector<std::vector<int64_t>> values = {
+      {1, 0, 3, 1}, {2, 1, 3, 2}, {0, 0, 1, 7}, {5, 4, 3, 2}};
+  std::vector<Plaintext> plaintexts;
+  for (const auto &v : values) {
+    plaintexts.push_back(cc->MakePackedPlaintext(v));
+  }
+  std::vector<Ciphertext<DCRTPoly>> ciphertexts =
+      cc->EncryptBatch(plaintexts, kp.publicKey);
+
+  auto cipherKeys =
+      cc->GenDecKeysFor(ciphertexts, kp.cipherKeyGen, kp.publicKey);
+  ASSERT_EQ(ciphertexts.size(), cipherKeys.size());
+
+  for (size_t i = 0; i < ciphertexts.size(); i++) {
+    Plaintext result;
+    cc->DecryptSFDK(ciphertexts[i], cipherKeys[i], kp.publicKey, &result);
+    result->SetLength(values[i].size());
+    EXPECT_EQ(values[i], result->GetPackedValue())
+        << "Batched OTK decryption fails for ciphertext " << i;
+  }
+}
+
+TEST_F(UTBFVrnsOTK, OTK_Decrypt_Decryptor) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  auto decryptor = cc->MakeDecryptor(kp.publicKey);
+
+  std::vector<std::vector<int64_t>> values = {{3, 1, 4, 1}, {5, 9, 2, 6}};
+  for (const auto &v : values) {
+    Ciphertext<DCRTPoly> ciphertext =
+        cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext(v));
+    auto cipherKey =
+        cc->GenDecKeyFor(ciphertext, kp.cipherKeyGen, kp.publicKey);
+
+    Plaintext result;
+    decryptor->Decrypt(ciphertext, cipherKey, &result);
+    result->SetLength(v.size());
+    EXPECT_EQ(v, result->GetPackedValue())
+        << "OTK decryption with a reusable decryptor fails";
+  }
+}
+
+TEST_F(UTBFVrnsOTK, OTK_Decrypt_SeededPublicKey) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext(true);
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+
+  ASSERT_TRUE(kp.publicKey->IsSeeded());
+  const Matrix<DCRTPoly> &A = kp.publicKey->GetLargePublicElements()[1];
+  EXPECT_EQ(A(0, 1), SdfkUtils::expandUniform(kp.publicKey->GetSeed(),
+                                              cc->GetElementParams()))
+      << "Uniform column of the public key does not match its seed";
+
+  std::vector<int64_t> vectorOfInts = {4, 0, 3, 1, 7, 1, 2, 5};
+  Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+  Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(kp.publicKey, plaintext);
+
+  auto cipherKey = cc->GenDecKeyFor(ciphertext, kp.cipherKeyGen, kp.publicKey);
+  Plaintext result;
+  cc->DecryptSFDK(ciphertext, cipherKey, kp.publicKey, &result);
+  result->SetLength(vectorOfInts.size());
+
+  EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+      << "OTK decryption with a seeded public key fails";
+}
+
+TEST_F(UTBFVrnsOTK, OTK_Decrypt_SeededContext) {
+  std::vector<int64_t> vectorOfInts = {1, 4, 1, 4, 2, 1, 3, 5};
+
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext(false, 0, 20241017);
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+  Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(kp.publicKey, plaintext);
+
+  // Seeded and unseeded contexts of the same parameters are not shared
+  EXPECT_NE(cc, GenerateOTKContext())
+      << "Factory shares a seeded context with an unseeded one";
+
+  // The factory gives back the same context, which repeats the keys and the
+  // encryption once its stream is restarted
+  CryptoContextSFDK<DCRTPoly> cc2 = GenerateOTKContext(false, 0, 20241017);
+  ASSERT_EQ(cc, cc2);
+  cc->ResetPRNGStream();
+  KeyPairSFDK<DCRTPoly> kp2 = cc->KeyGenSFDK();
+  Ciphertext<DCRTPoly> ciphertext2 =
+      cc->Encrypt(kp2.publicKey, cc->MakePackedPlaintext(vectorOfInts));
+
+  EXPECT_EQ(kp.secretKey->GetPrivateElement(),
+            kp2.secretKey->GetPrivateElement())
+      << "Restarted stream does not repeat the secret key";
+  EXPECT_EQ(kp.publicKey->GetLargePublicElements()[0],
+            kp2.publicKey->GetLargePublicElements()[0])
+      << "Restarted stream does not repeat the public key";
+  EXPECT_EQ(ciphertext->GetElements(), ciphertext2->GetElements())
+      << "Restarted stream does not repeat the encryption";
+
+  // A new context of the same seed repeats them too
+  CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+  CryptoContextSFDK<DCRTPoly> cc3 = GenerateOTKContext(false, 0, 20241017);
+  KeyPairSFDK<DCRTPoly> kp3 = cc3->KeyGenSFDK();
+  Ciphertext<DCRTPoly> ciphertext3 =
+      cc3->Encrypt(kp3.publicKey, cc3->MakePackedPlaintext(vectorOfInts));
+
+  EXPECT_EQ(kp.secretKey->GetPrivateElement(),
+            kp3.secretKey->GetPrivateElement())
+      << "Seeded context does not repeat the secret key";
+  EXPECT_EQ(kp.publicKey->GetLargePublicElements()[0],
+            kp3.publicKey->GetLargePublicElements()[0])
+      << "Seeded context does not repeat the public key";
+  EXPECT_EQ(ciphertext->GetElements(), ciphertext3->GetElements())
+      << "Seeded context does not repeat the encryption";
+
+  // The next call of the context gets a new stream
+  Ciphertext<DCRTPoly> ciphertext4 =
+      cc3->Encrypt(kp3.publicKey, cc3->MakePackedPlaintext(vectorOfInts));
+  EXPECT_NE(ciphertext3->GetElements(), ciphertext4->GetElements())
+      << "Seeded context repeats the stream of a call";
+
+  auto cipherKey =
+      cc3->GenDecKeyFor(ciphertext4, kp3.cipherKeyGen, kp3.publicKey);
+  Plaintext result;
+  cc3->DecryptSFDK(ciphertext4, cipherKey, kp3.publicKey, &result);
+  result->SetLength(vectorOfInts.size());
+
+  EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+      << "OTK decryption in a seeded context fails";
+}
+
+TEST_F(UTBFVrnsOTK, OTK_Decrypt_ApproxTrapdoor) {
+  // Width of the exact trapdoor for the same parameters
+  CryptoContextSFDK<DCRTPoly> ccExact = GenerateOTKContext();
+  const size_t exactCols =
+      ccExact->KeyGenSFDK().publicKey->GetLargePublicElements()[1].GetCols();
+
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext(false, 1);
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+
+  // One gadget digit less than the full trapdoor of the modulus
+  const size_t digits =
+      (cc->GetElementParams()->GetModulus().GetMSB() + 21) / 22;
+  const Matrix<DCRTPoly> &A = kp.publicKey->GetLargePublicElements()[1];
+  EXPECT_EQ(A.GetCols(), digits + 1) << "Approximate trapdoor has wrong size";
+  EXPECT_LT(A.GetCols(), exactCols)
+      << "Approximate trapdoor is not smaller than the exact one";
+
+  std::vector<int64_t> vectorOfInts = {3, 1, 4, 1, 5, 9, 2, 6};
+  Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+  Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(kp.publicKey, plaintext);
+
+  auto cipherKey = cc->GenDecKeyFor(ciphertext, kp.cipherKeyGen, kp.publicKey);
+  Plaintext result;
+  cc->DecryptSFDK(ciphertext, cipherKey, kp.publicKey, &result);
+  result->SetLength(vectorOfInts.size());
+
+  EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+      << "OTK decryption with an approximate trapdoor fails";
+}
+
+TEST_F(UTBFVrnsOTK, OTK_PackedKey) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+
+  std::vector<int64_t> vectorOfInts = {2, 7, 1, 8, 2, 8, 1, 8};
+  Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+  Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(kp.publicKey, plaintext);
+  auto cipherKey = cc->GenDecKeyFor(ciphertext, kp.cipherKeyGen, kp.publicKey);
+
+  // Wire format of the serialized key
+  const Matrix<DCRTPoly> &zHat = *cipherKey->getPrivateElement();
+  std::vector<uint8_t> packed = SdfkUtils::packSmall(zHat);
+  const DCRTPoly &entry = zHat(0, 0);
+  EXPECT_LT(packed.size(), zHat.GetRows() * entry.GetRingDimension() *
+                               entry.GetNumOfElements() * sizeof(uint64_t) / 2)
+      << "Packed key is not compact";
+
+  Matrix<DCRTPoly> unpacked =
+      SdfkUtils::unpackSmall(packed, zHat.GetRows(), cc->GetElementParams());
+  EXPECT_EQ(zHat, unpacked) << "Packed key does not round trip";
+
+  auto loadedKey = std::make_shared<KeyCipherImpl<DCRTPoly>>(
+      std::make_shared<Matrix<DCRTPoly>>(std::move(unpacked)), kp.publicKey);
+  Plaintext result;
+  cc->DecryptSFDK(ciphertext, loadedKey, kp.publicKey, &result);
+  result->SetLength(vectorOfInts.size());
+  EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+      << "OTK decryption with an unpacked key fails";
+}
+
+TEST_F(UTBFVrnsOTK, OTK_GadgetSampler) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext();
+  auto params = cc->GetElementParams();
+  const uint64_t base = 4194304;
+  const size_t k = (params->GetModulus().GetMSB() + 21) / 22;
+
+  GadgetSamplerSFDK sampler(params, base, k);
+  DCRTPoly::DugType dug;
+  DCRTPoly u(dug, params, Format::COEFFICIENT);
+  DCRTPoly::DggType dgg(SIGMA);
+  Matrix<int64_t> z([]() { return 0; }, k, params->GetRingDimension());
+  sampler.SampleGq(u, dgg, &z);
+
+  // sum_t base^t z(t, j) must be u[j] in every tower
+  for (size_t i = 0; i < u.GetNumOfElements(); i++) {
+    const NativeInteger &q = params->GetParams()[i]->GetModulus();
+    for (size_t j = 0; j < params->GetRingDimension(); j++) {
+      NativeInteger sum = 0;
+      NativeInteger power = 1;
+      for (size_t t = 0; t < k; t++) {
+        NativeInteger digit = NativeInteger(std::abs(z(t, j))).Mod(q);
+        if (z(t, j) < 0) {
+          digit = q.ModSub(digit, q);
+        }
+        sum = sum.ModAdd(digit.ModMul(power, q), q);
+        power = power.ModMul(NativeInteger(base), q);
+      }
+      ASSERT_EQ(u.GetElementAtIndex(i)[j], sum)
+          << "Gadget sample does not match the syndrome at tower " << i;
+    }
+  }
+}
+
+TEST_F(UTBFVrnsOTK, OTK_LazyDotProd_SmallModuli) {
+  // 30-bit towers leave the low word of the lazy accumulator far above q^2
+  auto params = std::make_shared<DCRTPoly::Params>(2048, 3, 30);
+  const size_t size = 64;
+  DCRTPoly::DugType dug;
+  auto zeroAlloc = DCRTPoly::Allocator(params, Format::EVALUATION);
+  Matrix<DCRTPoly> a(zeroAlloc, 1, size);
+  Matrix<DCRTPoly> b(zeroAlloc, size, 1);
+  for (size_t i = 0; i < size; i++) {
+    a(0, i) = DCRTPoly(dug, params, Format::EVALUATION);
+    b(i, 0) = DCRTPoly(dug, params, Format::EVALUATION);
+  }
+
+  EXPECT_EQ(SdfkUtils::dotProd(a, b), SdfkUtils::lazyDotProd(a, b))
+      << "Lazy inner product does not match on 30-bit moduli";
+}
+
+TEST_F(UTBFVrnsOTK, OTK_SerializePublicKey) {
+  for (bool seeded : {false, true}) {
+    CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext(seeded);
+    KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+
+    PublicKeySFDK<DCRTPoly> publicKey = SerialRoundTrip(kp.publicKey);
+    ASSERT_NE(publicKey, nullptr);
+    EXPECT_EQ(*kp.publicKey, *publicKey)
+        << "Public key does not round trip, seeded " << seeded;
+
+    std::vector<int64_t> vectorOfInts = {3, 1, 4, 1, 5, 9, 2, 6};
+    Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+    Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(publicKey, plaintext);
+    auto cipherKey = cc->GenDecKeyFor(ciphertext, kp.cipherKeyGen, publicKey);
+
+    Plaintext result;
+    cc->DecryptSFDK(ciphertext, cipherKey, publicKey, &result);
+    result->SetLength(vectorOfInts.size());
+    EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+        << "OTK decryption with a loaded public key fails, seeded " << seeded;
+
+    CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+  }
+}
+
+TEST_F(UTBFVrnsOTK, OTK_SerializeCipherKey) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+
+  std::vector<int64_t> vectorOfInts = {2, 7, 1, 8, 2, 8, 1, 8};
+  Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+  Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(kp.publicKey, plaintext);
+  auto cipherKey = cc->GenDecKeyFor(ciphertext, kp.cipherKeyGen, kp.publicKey);
+
+  KeyCipher<DCRTPoly> loadedKey = SerialRoundTrip(cipherKey);
+  ASSERT_NE(loadedKey, nullptr);
+  EXPECT_EQ(*cipherKey->getPrivateElement(), *loadedKey->getPrivateElement())
+      << "One-time key does not round trip";
+
+  Plaintext result;
+  cc->DecryptSFDK(ciphertext, loadedKey, kp.publicKey, &result);
+  result->SetLength(vectorOfInts.size());
+  EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+      << "OTK decryption with a loaded one-time key fails";
+}
+
+TEST_F(UTBFVrnsOTK, OTK_SerializeCipherKeyGen) {
+  CryptoContextSFDK<DCRTPoly> cc = GenerateOTKContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+
+  KeyCipherGenKey<DCRTPoly> keyGen = SerialRoundTrip(kp.cipherKeyGen);
+  ASSERT_NE(keyGen, nullptr);
+  EXPECT_EQ(kp.cipherKeyGen->GetPerturbationFactors().size(),
+            keyGen->GetPerturbationFactors().size())
+      << "Perturbation factors are not restored";
+
+  std::vector<int64_t> vectorOfInts = {1, 4, 1, 4, 2, 1, 3, 5};
+  Plaintext plaintext = cc->MakePackedPlaintext(vectorOfInts);
+  Ciphertext<DCRTPoly> ciphertext = cc->Encrypt(kp.publicKey, plaintext);
+  auto cipherKey = cc->GenDecKeyFor(ciphertext, keyGen, kp.publicKey);
+
+  Plaintext result;
+  cc->DecryptSFDK(ciphertext, cipherKey, kp.publicKey, &result);
+  result->SetLength(vectorOfInts.size());
+  EXPECT_EQ(plaintext->GetPackedValue(), result->GetPackedValue())
+      << "OTK decryption with a key of a loaded generator fails";
+}
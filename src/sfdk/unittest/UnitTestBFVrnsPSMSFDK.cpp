@@ -0,0 +1,410 @@
+// @file
+// @author Carlos Ribeiro
+//
+
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "cryptocontext-sfdk.h"
+#include "scheme/bfvrns-sfdk/bfvrns-ser-sfdk.h"
+
+#include "encoding/encodings.h"
+
+#include "utils/debug.h"
+
+using namespace std;
+using namespace lbcrypto;
+
+class UTBFVrnsPSM : public ::testing::Test {
+ protected:
+  void SetUp() {}
+
+  void TearDown() {
+    CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+  }
+
+ public:
+};
+
+static CryptoContextSFDK<DCRTPoly> GeneratePSMContext(
+    uint32_t depth = SFDKBFVRNS::GetPSMDepth(65537),
+    PlaintextModulus plaintextModulus = 65537, uint32_t ringDim = 0) {
+  CCParams<CryptoContextBFVRNSSFDK> parameters;
+  parameters.SetPlaintextModulus(plaintextModulus);
+  parameters.SetMultiplicativeDepth(depth);
+  parameters.SetBase(4194304);
+  if (ringDim > 0) {
+    // Small plaintext moduli only batch in small rings
+    parameters.SetSecurityLevel(HEStd_NotSet);
+    parameters.SetRingDim(ringDim);
+  }
+
+  CryptoContextSFDK<DCRTPoly> cc = GenCryptoContext(parameters);
+  cc->Enable(PKE);
+  cc->Enable(KEYSWITCH);
+  cc->Enable(LEVELEDSHE);
+  cc->Enable(SFDK);
+  return cc;
+}
+
+static int64_t DecryptSlot0(CryptoContextSFDK<DCRTPoly> cc,
+                            const PrivateKey<DCRTPoly> &secretKey,
+                            Ciphertext<DCRTPoly> &ciphertext) {
+  Plaintext result;
+  cc->Decrypt(secretKey, ciphertext, &result);
+  return result->GetPackedValue()[0];
+}
+
+// Serializes an object and loads it back, as a key sent over the wire
+template <typename T>
+static T SerialRoundTrip(const T &obj) {
+  std::stringstream stream;
+  Serial::Serialize(obj, stream, SerType::BINARY);
+  T loaded;
+  Serial::Deserialize(loaded, stream, SerType::BINARY);
+  return loaded;
+}
+
+TEST_F(UTBFVrnsPSM, PSM_Set) {
+  CryptoContextSFDK<DCRTPoly> cc = GeneratePSMContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->PreparePSM(kp.secretKey, 16);
+
+  std::vector<int64_t> set3 = {4, 8, 15};
+  std::vector<int64_t> set9 = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  auto query = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({8}));
+
+  auto in3 = cc->PrivateSetMembership(query, set3);
+  auto in9 = cc->PrivateSetMembership(query, set9);
+  EXPECT_EQ(0, DecryptSlot0(cc, kp.secretKey, in3)) << "Member not found";
+  EXPECT_EQ(0, DecryptSlot0(cc, kp.secretKey, in9)) << "Member not found";
+
+  auto other = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({23}));
+  auto out9 = cc->PrivateSetMembership(other, set9);
+  EXPECT_EQ(1, DecryptSlot0(cc, kp.secretKey, out9)) << "Non member found";
+}
+
+TEST_F(UTBFVrnsPSM, PSM_Set_Replicated) {
+  CryptoContextSFDK<DCRTPoly> cc =
+      GeneratePSMContext(SFDKBFVRNS::GetPSMDepth(65537, 1, true));
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->PreparePSM(kp.secretKey, 16);
+
+  std::vector<int64_t> set = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<int64_t> filled(cc->GetRingDimension(), 7);
+  auto query = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext(filled));
+  auto in = cc->PrivateSetMembershipReplicated(query, set);
+  EXPECT_EQ(0, DecryptSlot0(cc, kp.secretKey, in)) << "Member not found";
+
+  std::fill(filled.begin(), filled.end(), 11);
+  auto other = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext(filled));
+  auto out = cc->PrivateSetMembershipReplicated(other, set);
+  EXPECT_EQ(1, DecryptSlot0(cc, kp.secretKey, out)) << "Non member found";
+}
+
+TEST_F(UTBFVrnsPSM, PSM_PowerCircuit) {
+  // 65536 = 2^16: the squaring chain alone
+  PowerCircuit c65536 = SFDKBFVRNS::PlanPowerCircuit(65536);
+  EXPECT_EQ(16u, c65536.depth);
+  EXPECT_EQ(16u, c65536.GetMultCount());
+
+  // 256 = 2^8: x^(t-1) for t = 257
+  EXPECT_EQ(9u, SFDKBFVRNS::GetPSMDepth(257));
+  EXPECT_EQ(11u, SFDKBFVRNS::GetPSMDepth(257, 3));
+  EXPECT_EQ(10u, SFDKBFVRNS::GetPSMDepth(257, 1, true));
+
+  // 7 = 111b: x^4 * (x^2 * x) at depth ceil(log2(7)) = 3
+  PowerCircuit c7 = SFDKBFVRNS::PlanPowerCircuit(7);
+  EXPECT_EQ(3u, c7.depth);
+  EXPECT_EQ(4u, c7.GetMultCount());
+
+  // 786432 = 2^19 + 2^18
+  PowerCircuit c786432 = SFDKBFVRNS::PlanPowerCircuit(786432);
+  EXPECT_EQ(20u, c786432.depth);
+  EXPECT_EQ(20u, c786432.GetMultCount());
+}
+
+TEST_F(UTBFVrnsPSM, PSM_Set_Packed) {
+  CryptoContextSFDK<DCRTPoly> cc = GeneratePSMContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->PreparePSM(kp.secretKey, 16);
+
+  const uint blockWidth = 16;
+  std::vector<int64_t> set = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<int64_t> queries = {8, 23, 1, 50, 9};
+  auto query =
+      cc->Encrypt(kp.publicKey, cc->MakePackedQueries(queries, blockWidth));
+  auto answers = cc->PrivateSetMembershipPacked(query, set, blockWidth);
+
+  Plaintext result;
+  cc->Decrypt(kp.secretKey, answers, &result);
+  std::vector<int64_t> expected = {0, 1, 0, 1, 0};
+  for (size_t i = 0; i < queries.size(); i++) {
+    EXPECT_EQ(expected[i], result->GetPackedValue()[i * blockWidth])
+        << "Wrong answer for packed query " << i;
+  }
+}
+
+TEST_F(UTBFVrnsPSM, PSM_Set_Chunked) {
+  CryptoContextSFDK<DCRTPoly> cc =
+      GeneratePSMContext(SFDKBFVRNS::GetPSMDepth(65537, 3));
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  const uint row = cc->GetRingDimension() / 2;
+  cc->PreparePSM(kp.secretKey, row);
+
+  // Two full chunks and a short one, with a repeated element
+  std::vector<int64_t> set(2 * row + 5);
+  std::iota(set.begin(), set.end(), 100);
+  set.push_back(100);
+
+  auto member = cc->Encrypt(kp.publicKey,
+                            cc->MakePackedPlaintext({set[2 * row + 3]}));
+  auto result = cc->PrivateSetMembership(member, set);
+  EXPECT_EQ(0, DecryptSlot0(cc, kp.secretKey, result))
+      << "Member of the last chunk not found";
+
+  auto first = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({100}));
+  result = cc->PrivateSetMembership(first, set);
+  EXPECT_EQ(0, DecryptSlot0(cc, kp.secretKey, result))
+      << "Repeated member not found";
+
+  auto outsider = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({99}));
+  result = cc->PrivateSetMembership(outsider, set);
+  EXPECT_EQ(1, DecryptSlot0(cc, kp.secretKey, result))
+      << "Non member found in a chunked set";
+}
+
+TEST_F(UTBFVrnsPSM, PSM_Range_Digits) {
+  const uint base = 10;
+  const uint digits = 4;
+  CryptoContextSFDK<DCRTPoly> cc =
+      GeneratePSMContext(SFDKBFVRNS::GetRangeDepth(65537, digits));
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->PrepareRangeMembership(kp.secretKey, base, digits);
+
+  // [1234, 6234) is covered by blocks of every level up to 10^3
+  std::vector<uint64_t> queries = {1234, 6233, 4999, 1233, 6234, 7};
+  std::vector<int64_t> expected = {0, 0, 0, 1, 1, 1};
+  for (size_t i = 0; i < queries.size(); i++) {
+    auto query = cc->Encrypt(kp.publicKey,
+                             cc->MakeDigitQuery(queries[i], base, digits));
+    auto result =
+        cc->PrivateRangeMembership(query, 1234, 5000, base, digits);
+    EXPECT_EQ(expected[i], DecryptSlot0(cc, kp.secretKey, result))
+        << "Wrong range answer for " << queries[i];
+  }
+}
+
+TEST_F(UTBFVrnsPSM, PSM_PlaintextCache) {
+  CryptoContextSFDK<DCRTPoly> cc = GeneratePSMContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->PreparePSM(kp.secretKey, 16);
+  auto cache = cc->GetPlaintextCache();
+
+  // The set chunks and the count masks are encoded once
+  std::vector<int64_t> set = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  auto member = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({8}));
+  auto outsider = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({23}));
+  auto in = cc->PrivateSetMembership(member, set);
+  EXPECT_EQ(2u, cache->GetMisses());
+  EXPECT_EQ(0u, cache->GetHits());
+  auto out = cc->PrivateSetMembership(outsider, set);
+  EXPECT_EQ(2u, cache->GetMisses());
+  EXPECT_EQ(2u, cache->GetHits());
+  EXPECT_EQ(2u, cache->Size());
+  EXPECT_EQ(0, DecryptSlot0(cc, kp.secretKey, in)) << "Member not found";
+  EXPECT_EQ(1, DecryptSlot0(cc, kp.secretKey, out)) << "Non member found";
+
+  // Without memory nothing is kept, and the results do not change
+  cc->SetPlaintextCacheLimit(0);
+  EXPECT_EQ(0u, cache->Size());
+  EXPECT_EQ(0u, cache->GetBytes());
+  in = cc->PrivateSetMembership(member, set);
+  EXPECT_EQ(0u, cache->Size());
+  EXPECT_EQ(0, DecryptSlot0(cc, kp.secretKey, in)) << "Member not found";
+}
+
+TEST_F(UTBFVrnsPSM, PSM_RotationPlan) {
+  // 9 = 2 blocks of 4 and 1: baby steps, one doubling, one placement, and
+  // a window of 16 slots
+  std::vector<int32_t> plan9 = {-8, -4, -3, -2, -1, 1, 2, 4, 8};
+  EXPECT_EQ(plan9, SFDKBFVRNS::PlanPSMRotations(9));
+  std::vector<int32_t> replicated9 = {1, 2, 4, 8};
+  EXPECT_EQ(replicated9, SFDKBFVRNS::PlanPSMRotations(9, false));
+  EXPECT_TRUE(SFDKBFVRNS::PlanPSMRotations(1).empty());
+
+  CryptoContextSFDK<DCRTPoly> cc = GeneratePSMContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->EnableLazyRotationKeys(kp.secretKey);
+
+  // No rotation key exists until the first test needs them
+  EXPECT_TRUE(cc->GetRotationKeyMemory(kp.secretKey->GetKeyTag()).empty());
+  std::vector<int64_t> set = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  auto query = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({8}));
+  auto result = cc->PrivateSetMembership(query, set);
+  EXPECT_EQ(0, DecryptSlot0(cc, kp.secretKey, result)) << "Member not found";
+
+  auto memory = cc->GetRotationKeyMemory(kp.secretKey->GetKeyTag());
+  EXPECT_EQ(plan9.size(), memory.size());
+  for (const auto &key : memory) {
+    EXPECT_GT(key.second, 0u) << "Empty rotation key " << key.first;
+  }
+}
+
+TEST_F(UTBFVrnsPSM, PSM_AggregateResults) {
+  CryptoContextSFDK<DCRTPoly> cc = GeneratePSMContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->PreparePSM(kp.secretKey, 16);
+
+  std::vector<int64_t> set = {4, 8, 15, 16, 23, 42};
+  std::vector<int64_t> queries = {8, 9, 42, 0, 23};
+  cc->PrepareAggregation(kp.secretKey, queries.size());
+  std::vector<Ciphertext<DCRTPoly>> results;
+  for (int64_t q : queries) {
+    auto query = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({q}));
+    results.push_back(cc->PrivateSetMembership(query, set));
+  }
+
+  // One one-time key opens every answer
+  auto merged = cc->AggregateResults(results);
+  auto cipherKey = cc->GenDecKeyFor(merged, kp.cipherKeyGen, kp.publicKey);
+  Plaintext result;
+  cc->DecryptSFDK(merged, cipherKey, kp.publicKey, &result);
+  result->SetLength(queries.size());
+  std::vector<int64_t> expected = {0, 1, 0, 1, 0};
+  EXPECT_EQ(expected, result->GetPackedValue())
+      << "Aggregated membership answers are wrong";
+}
+
+TEST_F(UTBFVrnsPSM, PSM_AggregateResults_Packed) {
+  // One more level for the mask of the packed answers
+  CryptoContextSFDK<DCRTPoly> cc =
+      GeneratePSMContext(SFDKBFVRNS::GetPSMDepth(65537) + 1);
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->PreparePSM(kp.secretKey, 16);
+
+  const uint blockWidth = 16;
+  std::vector<int64_t> set = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<std::vector<int64_t>> queries = {{8, 23}, {50, 1}};
+  cc->PrepareAggregation(kp.secretKey, queries.size());
+  std::vector<Ciphertext<DCRTPoly>> results;
+  for (const auto &q : queries) {
+    auto query = cc->Encrypt(kp.publicKey, cc->MakePackedQueries(q, blockWidth));
+    results.push_back(cc->PrivateSetMembershipPacked(query, set, blockWidth));
+  }
+
+  // Only the first answer of each result is kept, the answers at the other
+  // block starts must not leak into the merged slots
+  auto merged = cc->AggregateResults(results, true);
+  auto cipherKey = cc->GenDecKeyFor(merged, kp.cipherKeyGen, kp.publicKey);
+  Plaintext result;
+  cc->DecryptSFDK(merged, cipherKey, kp.publicKey, &result);
+  result->SetLength(2 * blockWidth);
+  std::vector<int64_t> expected(2 * blockWidth, 0);
+  expected[1] = 1;
+  EXPECT_EQ(expected, result->GetPackedValue())
+      << "Aggregated packed answers are wrong";
+}
+
+TEST_F(UTBFVrnsPSM, PSM_CompactResult_SerializedKey) {
+  CryptoContextSFDK<DCRTPoly> cc = GeneratePSMContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->PreparePSM(kp.secretKey, 16);
+  auto reduced = cc->GenReducedKeys(kp.publicKey, kp.cipherKeyGen, 2);
+
+  std::vector<int64_t> set = {4, 8, 15, 16, 23, 42};
+  auto query = cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({14}));
+  auto result = cc->CompactResult(cc->PrivateSetMembership(query, set), 2);
+  auto cipherKey = cc->GenDecKeyFor(result, reduced.second, reduced.first);
+
+  // The loaded key keeps the two towers of the compacted result
+  KeyCipher<DCRTPoly> loadedKey = SerialRoundTrip(cipherKey);
+  ASSERT_NE(loadedKey, nullptr);
+  ASSERT_EQ(2u, (*loadedKey->getPrivateElement())(0, 0).GetNumOfElements());
+
+  Plaintext answer;
+  cc->DecryptSFDK(result, loadedKey, reduced.first, &answer);
+  EXPECT_EQ(1, answer->GetPackedValue()[0])
+      << "Wrong answer from a compact result with a loaded key";
+}
+
+TEST_F(UTBFVrnsPSM, PSM_CompactResult) {
+  CryptoContextSFDK<DCRTPoly> cc = GeneratePSMContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+  cc->PreparePSM(kp.secretKey, 16);
+  auto reduced = cc->GenReducedKeys(kp.publicKey, kp.cipherKeyGen, 2);
+
+  std::vector<int64_t> set = {4, 8, 15, 16, 23, 42};
+  std::vector<int64_t> queries = {15, 14};
+  std::vector<int64_t> expected = {0, 1};
+  for (size_t i = 0; i < queries.size(); i++) {
+    auto query =
+        cc->Encrypt(kp.publicKey, cc->MakePackedPlaintext({queries[i]}));
+    auto result = cc->CompactResult(cc->PrivateSetMembership(query, set), 2);
+    ASSERT_EQ(2u, result->GetElements()[0].GetNumOfElements());
+
+    // The one-time key is sampled over the two towers left
+    auto cipherKey = cc->GenDecKeyFor(result, reduced.second, reduced.first);
+    Plaintext answer;
+    cc->DecryptSFDK(result, cipherKey, reduced.first, &answer);
+    EXPECT_EQ(expected[i], answer->GetPackedValue()[0])
+        << "Wrong answer from a compact result for " << queries[i];
+  }
+}
+
+TEST_F(UTBFVrnsPSM, PSM_Cardinality) {
+  CryptoContextSFDK<DCRTPoly> cc = GeneratePSMContext();
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+
+  const uint blockWidth = 16;
+  cc->EvalAtIndexKeyGen(kp.secretKey,
+                        SFDKBFVRNS::PlanCardinalityRotations(
+                            9, blockWidth, cc->GetRingDimension()));
+
+  // 0 is in the set, so the empty blocks must not be counted
+  std::vector<int64_t> set = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+  std::vector<int64_t> queries = {8, 23, 1, 50, 9, 0};
+  auto query =
+      cc->Encrypt(kp.publicKey, cc->MakePackedQueries(queries, blockWidth));
+  auto count = cc->PrivateSetIntersectionCardinality(query, set, blockWidth,
+                                                     queries.size());
+  EXPECT_EQ(3, DecryptSlot0(cc, kp.secretKey, count))
+      << "Wrong number of matching queries";
+}
+
+TEST_F(UTBFVrnsPSM, PSM_Cardinality_SmallModulus) {
+  // t = 257 batches in rings up to 128
+  CryptoContextSFDK<DCRTPoly> cc =
+      GeneratePSMContext(SFDKBFVRNS::GetPSMDepth(257), 257, 128);
+  KeyPairSFDK<DCRTPoly> kp = cc->KeyGenSFDK();
+  cc->EvalMultKeyGen(kp.secretKey);
+
+  const uint blockWidth = 16;
+  cc->EvalAtIndexKeyGen(kp.secretKey,
+                        SFDKBFVRNS::PlanCardinalityRotations(
+                            9, blockWidth, cc->GetRingDimension()));
+
+  std::vector<int64_t> set = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+  std::vector<int64_t> queries = {8, 23, 0, 5};
+  auto query =
+      cc->Encrypt(kp.publicKey, cc->MakePackedQueries(queries, blockWidth));
+  auto count = cc->PrivateSetIntersectionCardinality(query, set, blockWidth,
+                                                     queries.size());
+  EXPECT_EQ(3, DecryptSlot0(cc, kp.secretKey, count))
+      << "Wrong number of matching queries for a small plaintext modulus";
+}